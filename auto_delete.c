@@ -7,11 +7,49 @@ int isDirectory(const char* path) {
     }
     return S_ISDIR(path_stat.st_mode);
 }
-void check_file_and_delete_time(const char* path, int duration, char flag) {
+
+// Depth first walk of everything below path, symbolic links are followed
+int walk_directory(const char* path, walk_visitor visit, void* context) {
     struct dirent *de;
-    struct stat path_stat;
-    stat(path, &path_stat);
+    struct stat statbuf;
     DIR *dr = opendir(path);
+
+    if(dr == NULL) {
+        fprintf(stderr, "Couldn't open the directory: %s\n", path);
+        return -1;
+    }
+
+    while((de = readdir(dr)) != NULL) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) {
+            continue;
+        }
+
+        char* file_path = malloc(strlen(path) + strlen(de->d_name) + 2);
+        snprintf(file_path, strlen(path) + strlen(de->d_name) + 2, "%s/%s", path, de->d_name);
+
+        if(stat(file_path, &statbuf) == 0) {
+            bool descend = visit(file_path, &statbuf, context);
+            if(descend && S_ISDIR(statbuf.st_mode)) {
+                walk_directory(file_path, visit, context);
+            }
+        }
+        free(file_path);
+    }
+
+    closedir(dr);
+    return 0;
+}
+
+static bool delete_if_older(const char* path, const struct stat* st, void* context) {
+    time_t final_time = *(time_t*)context;
+    if(!S_ISDIR(st->st_mode) && st->st_ctime > final_time) {
+        remove(path);
+        printf("Deleted: %s | Creation Date: %s", path, ctime(&st->st_ctime));
+    }
+    return true;
+}
+
+void check_file_and_delete_time(const char* path, int duration, char flag) {
     time_t current_time = time(NULL);
     time_t final_time;
     switch(flag) {
@@ -28,76 +66,34 @@ void check_file_and_delete_time(const char* path, int duration, char flag) {
             final_time = current_time - duration;
             break;
     }
-    if(dr == NULL) {
-        fprintf(stderr, "Couldn't open the directory: %s\n", path);
-        return;
-    }
-    while((de = readdir(path)) != NULL) {
-        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) {
-            continue;
-        }
-        char* file_path = malloc(strlen(path) + strlen(de->d_name) + 2);
-        snprintf(file_path, strlen(path) + strlen(de->d_name) + 2, "%s/%s", path, de->d_name);
-        if(isDirectory(file_path)) {
-            check_file_and_delete_time(file_path, duration, flag);
-        } else {
-            if(path_stat.st_ctime > final_time) {
-                remove(file_path);
-                printf("Deleted: %s | Creation Date: %lld\n", file_path, ctime(path_stat.st_ctime));
-            }
-        }
+    walk_directory(path, delete_if_older, &final_time);
+}
+
+static bool delete_if_larger(const char* path, const struct stat* st, void* context) {
+    long long int size_in_bytes = *(long long int*)context;
+    if(!S_ISDIR(st->st_mode) && st->st_size > size_in_bytes) {
+        remove(path);
+        printf("Deleted %s | Size: %lld Bytes \n", path, (long long)st->st_size);
     }
+    return true;
 }
+
 void check_file_and_delete_size(const char* path, int size, char flag) {
-    struct dirent *de;
-    struct stat statbuf;
-    DIR *dr = opendir(path);
     long long int size_in_bytes;
 
     switch(flag) {
         case 'k':  
-            size_in_bytes = size * 1024;
+            size_in_bytes = size * 1024LL;
             break;
         case 'm':
-            size_in_bytes = size * 1024 * 1024;
+            size_in_bytes = size * 1024LL * 1024;
             break;
         case 'g':
-            size_in_bytes = size * 1024 * 1024 * 1024;
+            size_in_bytes = size * 1024LL * 1024 * 1024;
             break;
         default:
             size_in_bytes = size;
             break; 
     }
-
-    if(dr == NULL) {
-        fprintf(stderr, "Couldn't open the directory: %s\n", path);
-        return;
-    }
-
-    while((de = readdir(dr)) != NULL) {
-        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) {
-            continue;
-        }
-
-        char* file_path = malloc(strlen(path) + strlen(de->d_name) + 2);
-        snprintf(file_path, strlen(path) + strlen(de->d_name) + 2, "%s/%s", path, de->d_name);
-
-        if(isDirectory(file_path)) {
-
-            check_file_and_delete_size(file_path, size, flag);
-        } else {
-
-            if(stat(file_path, &statbuf) == 0) {
-                if(statbuf.st_size > size_in_bytes) {
-                    remove(file_path);
-                    printf("Deleted %s | Size: %lld Bytes \n", file_path, statbuf.st_size);
-                }
-            }
-        }
-        free(file_path);
-    }
-
-    closedir(dr);
+    walk_directory(path, delete_if_larger, &size_in_bytes);
 }
-
-
@@ -2,6 +2,7 @@
 #define AUTO_DELETE_H
 
 #include <stdio.h>
+#include <stdbool.h>
 #include <dirent.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -10,8 +11,12 @@
 #include <stdlib.h>
 #include <time.h>
 
+// called for every entry below the walked directory, returning false skips a directory's contents
+typedef bool (*walk_visitor)(const char* path, const struct stat* st, void* context);
+
 int isDirectory(const char* path);
+int walk_directory(const char* path, walk_visitor visit, void* context);
 void check_file_and_delete_size(const char* path, int size, char flag);
 void check_file_and_delete_time(const char* path, int time, char flag);
 
-#endif
\ No newline at end of file
+#endif
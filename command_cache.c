@@ -0,0 +1,298 @@
+#include "command_cache.h"
+#include "shell.h"
+#include "command_stats.h"
+#include "copy_engine.h"
+
+static void hash_init(CacheHash *hash) {
+    hash->a = 1469598103934665603ull;
+    hash->b = 0x9e3779b97f4a7c15ull;
+}
+
+// two independent 64 bit lanes, enough to make accidental collisions irrelevant for a cache
+static void hash_update(CacheHash *hash, const void *data, size_t length) {
+    const unsigned char *bytes = data;
+    uint64_t a = hash->a, b = hash->b;
+    for (size_t i = 0; i < length; i++) {
+        a = (a ^ bytes[i]) * 1099511628211ull;
+        b = (b + bytes[i]) * 0xff51afd7ed558ccdull;
+        b ^= b >> 29;
+    }
+    hash->a = a;
+    hash->b = b;
+}
+
+static void hash_field(CacheHash *hash, const char *text) {
+    hash_update(hash, text, strlen(text) + 1);
+}
+
+static void hash_hex(const CacheHash *hash, char *out) {
+    snprintf(out, CACHE_HASH_HEX, "%016llx%016llx", (unsigned long long)hash->a, (unsigned long long)hash->b);
+}
+
+// mkdir -p, also used for the other files the shell keeps under ~/.cache
+int make_dirs(const char *path) {
+    char partial[CACHE_PATH_SIZE];
+    snprintf(partial, sizeof(partial), "%s", path);
+    for (char *p = partial + 1; *p; p++) {
+        if (*p != '/')
+            continue;
+        *p = '\0';
+        if (mkdir(partial, 0700) == -1 && errno != EEXIST)
+            return -1;
+        *p = '/';
+    }
+    return mkdir(partial, 0700) == -1 && errno != EEXIST ? -1 : 0;
+}
+
+static int cache_root(char *out, size_t size) {
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    if (xdg && *xdg)
+        snprintf(out, size, "%s/%s", xdg, CACHE_DIR_NAME);
+    else if (home && *home)
+        snprintf(out, size, "%s/.cache/%s", home, CACHE_DIR_NAME);
+    else
+        snprintf(out, size, "/tmp/%s-%d", CACHE_DIR_NAME, (int)getuid());
+
+    char keys[CACHE_PATH_SIZE], blobs[CACHE_PATH_SIZE];
+    snprintf(keys, sizeof(keys), "%s/keys", out);
+    snprintf(blobs, sizeof(blobs), "%s/blobs", out);
+    if (make_dirs(keys) == -1 || make_dirs(blobs) == -1) {
+        fprintf(stderr, "cached: cannot create %s: %s\n", out, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// argv, cwd, the chosen environment variables and the identity of every declared input
+static int compute_key(char **command, char **env_names, int env_count, char **inputs, int input_count, char *key) {
+    CacheHash hash;
+    hash_init(&hash);
+
+    for (int i = 0; command[i]; i++)
+        hash_field(&hash, command[i]);
+    hash_field(&hash, "\x01cwd");
+    char cwd[CACHE_PATH_SIZE];
+    hash_field(&hash, getcwd(cwd, sizeof(cwd)) ? cwd : "");
+
+    hash_field(&hash, "\x01env");
+    for (int i = 0; i < env_count; i++) {
+        const char *value = getenv(env_names[i]);
+        hash_field(&hash, env_names[i]);
+        hash_field(&hash, value ? value : "\x02unset");
+    }
+
+    hash_field(&hash, "\x01inputs");
+    for (int i = 0; i < input_count; i++) {
+        struct stat st;
+        if (stat(inputs[i], &st) == -1) {
+            fprintf(stderr, "cached: %s: %s\n", inputs[i], strerror(errno));
+            return -1;
+        }
+        hash_field(&hash, inputs[i]);
+        hash_update(&hash, &st.st_dev, sizeof(st.st_dev));
+        hash_update(&hash, &st.st_ino, sizeof(st.st_ino));
+        hash_update(&hash, &st.st_size, sizeof(st.st_size));
+        hash_update(&hash, &st.st_mtim, sizeof(st.st_mtim));
+    }
+    hash_hex(&hash, key);
+    return 0;
+}
+
+static int read_entry(const char *path, CacheEntry *entry) {
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return -1;
+    long created;
+    int fields = fscanf(file, "status %d\ncreated %ld\nstdout %32s\nstderr %32s\n", &entry->exit_status, &created,
+                        entry->stdout_blob, entry->stderr_blob);
+    fclose(file);
+    entry->created = created;
+    return fields == 4 ? 0 : -1;
+}
+
+static int open_blob(const char *root, const char *blob) {
+    char path[CACHE_PATH_SIZE];
+    snprintf(path, sizeof(path), "%s/blobs/%s", root, blob);
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+// both blobs are opened before either is written, so a missing one never leaves half a replay behind.
+// Returns -1 when a blob is missing, 1 when writing the replay failed
+static int replay_entry(const char *root, const CacheEntry *entry) {
+    int stdout_fd = open_blob(root, entry->stdout_blob);
+    int stderr_fd = stdout_fd < 0 ? -1 : open_blob(root, entry->stderr_blob);
+    if (stderr_fd < 0) {
+        if (stdout_fd >= 0)
+            close(stdout_fd);
+        return -1;
+    }
+    int result = 0;
+    if (copy_fd(stdout_fd, STDOUT_FILENO) < 0 || copy_fd(stderr_fd, STDERR_FILENO) < 0) {
+        perror("cached: replay");
+        result = 1;
+    }
+    close(stdout_fd);
+    close(stderr_fd);
+    return result;
+}
+
+// hash a captured output and move it into blobs/ under that hash, identical outputs share one file
+static int store_blob(const char *root, const char *temp_path, int fd, char *blob) {
+    CacheHash hash;
+    hash_init(&hash);
+    char buffer[COPY_BUFFER_SIZE];
+    ssize_t n;
+    lseek(fd, 0, SEEK_SET);
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+        hash_update(&hash, buffer, n);
+    if (n < 0)
+        return -1;
+    hash_hex(&hash, blob);
+
+    char path[CACHE_PATH_SIZE];
+    snprintf(path, sizeof(path), "%s/blobs/%s", root, blob);
+    if (access(path, F_OK) == 0) {
+        unlink(temp_path);
+        return 0;
+    }
+    return rename(temp_path, path);
+}
+
+static int open_capture(const char *root, char *path) {
+    snprintf(path, CACHE_PATH_SIZE, "%s/blobs/.capture.XXXXXX", root);
+    int fd = mkstemp(path);
+    if (fd >= 0)
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return fd;
+}
+
+static int write_entry(const char *root, const char *key, const CacheEntry *entry) {
+    char temp_path[CACHE_PATH_SIZE], path[CACHE_PATH_SIZE];
+    snprintf(temp_path, sizeof(temp_path), "%s/keys/.%s.XXXXXX", root, key);
+    snprintf(path, sizeof(path), "%s/keys/%s", root, key);
+    int fd = mkstemp(temp_path);
+    if (fd < 0)
+        return -1;
+    dprintf(fd, "status %d\ncreated %ld\nstdout %s\nstderr %s\n", entry->exit_status, (long)entry->created,
+            entry->stdout_blob, entry->stderr_blob);
+    close(fd);
+    return rename(temp_path, path);
+}
+
+// run the command with stdout/stderr captured, store both, then play them back
+static int run_and_store(const char *root, const char *key, char **command) {
+    char out_path[CACHE_PATH_SIZE], err_path[CACHE_PATH_SIZE];
+    int out_fd = open_capture(root, out_path);
+    int err_fd = open_capture(root, err_path);
+    if (out_fd < 0 || err_fd < 0) {
+        fprintf(stderr, "cached: cannot create capture files: %s\n", strerror(errno));
+        if (out_fd >= 0) {
+            close(out_fd);
+            unlink(out_path);
+        }
+        return -1;
+    }
+
+    CacheEntry entry;
+    CommandUsage usage;
+    struct timespec started_at;
+    clock_gettime(CLOCK_MONOTONIC, &started_at);
+    pid_t pid = launch_command(command, -1, out_fd, err_fd);
+    int result = -1;
+    if (pid > 0 && wait_command(pid, 0, command[0], &started_at, &usage) == pid) {
+        entry.exit_status = usage.exit_status;
+        entry.created = time(NULL);
+        if (store_blob(root, out_path, out_fd, entry.stdout_blob) == 0 &&
+            store_blob(root, err_path, err_fd, entry.stderr_blob) == 0) {
+            result = write_entry(root, key, &entry);
+        }
+    }
+
+    // replay from the captures, they are still open even once renamed
+    lseek(out_fd, 0, SEEK_SET);
+    lseek(err_fd, 0, SEEK_SET);
+    copy_fd(out_fd, STDOUT_FILENO);
+    copy_fd(err_fd, STDERR_FILENO);
+    close(out_fd);
+    close(err_fd);
+    if (result != 0) {
+        unlink(out_path);
+        unlink(err_path);
+    }
+    return result;
+}
+
+static time_t parse_ttl(const char *text) {
+    char *end;
+    time_t value = strtol(text, &end, 10);
+    switch (*end) {
+        case 'm':
+            return value * 60;
+        case 'h':
+            return value * 60 * 60;
+        case 'd':
+            return value * 24 * 60 * 60;
+        default:
+            return value;
+    }
+}
+
+// cached [--ttl N[m|h|d]] [--env VAR]... [--input PATH]... [--refresh] command args...
+void handle_cached(char **args, int arg_count) {
+    time_t ttl = 0;
+    bool refresh = false;
+    char *env_names[CACHE_MAX_ENV];
+    char *inputs[CACHE_MAX_INPUTS];
+    int env_count = 0, input_count = 0;
+    int i = 1;
+
+    for (; i < arg_count && strncmp(args[i], "--", 2) == 0; i++) {
+        if (strcmp(args[i], "--refresh") == 0) {
+            refresh = true;
+        } else if (i + 1 < arg_count && strcmp(args[i], "--ttl") == 0) {
+            ttl = parse_ttl(args[++i]);
+        } else if (i + 1 < arg_count && strcmp(args[i], "--env") == 0 && env_count < CACHE_MAX_ENV) {
+            env_names[env_count++] = args[++i];
+        } else if (i + 1 < arg_count && strcmp(args[i], "--input") == 0 && input_count < CACHE_MAX_INPUTS) {
+            inputs[input_count++] = args[++i];
+        } else if (strcmp(args[i], "--") == 0) {
+            i++;
+            break;
+        } else {
+            break;
+        }
+    }
+    if (i >= arg_count) {
+        fprintf(stderr, "Usage: cached [--ttl N[m|h|d]] [--env VAR]... [--input PATH]... [--refresh] command args...\n");
+        record_builtin_status(EXIT_FAILURE);
+        return;
+    }
+    char **command = &args[i];
+    if (is_builtin(command)) {
+        fprintf(stderr, "cached: %s is a builtin, only external commands can be cached\n", command[0]);
+        record_builtin_status(EXIT_FAILURE);
+        return;
+    }
+
+    char root[CACHE_ROOT_SIZE], key[CACHE_HASH_HEX], entry_path[CACHE_PATH_SIZE];
+    if (cache_root(root, sizeof(root)) != 0 || compute_key(command, env_names, env_count, inputs, input_count, key) != 0) {
+        record_builtin_status(EXIT_FAILURE);
+        return;
+    }
+    snprintf(entry_path, sizeof(entry_path), "%s/keys/%s", root, key);
+
+    CacheEntry entry;
+    fflush(stdout);
+    if (!refresh && read_entry(entry_path, &entry) == 0 && (ttl == 0 || time(NULL) - entry.created < ttl)) {
+        int replayed = replay_entry(root, &entry);
+        if (replayed >= 0) {
+            record_builtin_status(replayed == 0 ? entry.exit_status : EXIT_FAILURE);
+            return;
+        }
+        // a blob went missing, fall through and rebuild the entry
+    }
+
+    if (run_and_store(root, key, command) != 0)
+        fprintf(stderr, "cached: result could not be stored\n");
+}
@@ -0,0 +1,42 @@
+#ifndef COMMAND_CACHE_H
+#define COMMAND_CACHE_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define CACHE_DIR_NAME "custom_shell/cached"
+#define CACHE_HASH_HEX 33
+#define CACHE_MAX_ENV 32
+#define CACHE_MAX_INPUTS 32
+#define CACHE_PATH_SIZE 4096
+#define CACHE_ROOT_SIZE (CACHE_PATH_SIZE - 64)
+
+typedef struct {
+    uint64_t a;
+    uint64_t b;
+} CacheHash;
+
+typedef struct {
+    int exit_status;
+    time_t created;
+    char stdout_blob[CACHE_HASH_HEX];
+    char stderr_blob[CACHE_HASH_HEX];
+} CacheEntry;
+
+int make_dirs(const char *path);
+void handle_cached(char **args, int arg_count);
+
+#endif
@@ -0,0 +1,209 @@
+#include "command_stats.h"
+#include "task_scheduler.h"
+
+CommandStats stats_table[STATS_TABLE_SIZE];
+int stats_used = 0;
+CommandUsage last_usage;
+CommandUsage window_usage;
+
+static double timeval_seconds(const struct timeval *tv) {
+    return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+static unsigned long hash_name(const char *name) {
+    unsigned long hash = 5381;
+    while (*name)
+        hash = hash * 33 + (unsigned char)*name++;
+    return hash;
+}
+
+static CommandStats *find_stats(const char *name, bool create) {
+    unsigned long slot = hash_name(name) % STATS_TABLE_SIZE;
+    for (int probe = 0; probe < STATS_TABLE_SIZE; probe++) {
+        CommandStats *entry = &stats_table[(slot + probe) % STATS_TABLE_SIZE];
+        if (entry->count == 0) {
+            if (!create || stats_used == STATS_TABLE_SIZE - 1)
+                return NULL;
+            strncpy(entry->name, name, STATS_NAME_SIZE - 1);
+            stats_used++;
+            return entry;
+        }
+        if (strcmp(entry->name, name) == 0)
+            return entry;
+    }
+    return NULL;
+}
+
+static void record_usage(const char *name, const CommandUsage *usage) {
+    const char *base = strrchr(name, '/');
+    CommandStats *entry = find_stats(base ? base + 1 : name, true);
+    if (!entry)
+        return;
+
+    double cpu = usage->user_time + usage->sys_time;
+    entry->count++;
+    entry->total_wall += usage->wall_time;
+    entry->total_cpu += cpu;
+    entry->total_rss_kb += usage->max_rss_kb;
+    entry->wall_samples[entry->next_sample] = usage->wall_time;
+    entry->cpu_samples[entry->next_sample] = cpu;
+    entry->rss_samples[entry->next_sample] = usage->max_rss_kb;
+    entry->next_sample = (entry->next_sample + 1) % STATS_WINDOW;
+}
+
+// Like waitpid, but also collects the child's rusage and wall time and records them under name
+pid_t reap_command(pid_t pid, int options, const char *name, const struct timespec *started_at, CommandUsage *usage) {
+    int status = 0;
+    struct rusage rusage;
+    pid_t result;
+
+    TRACE_BEGIN(wait_start);
+    do {
+        result = wait4(pid, &status, options, &rusage);
+    } while (result == -1 && errno == EINTR);
+    TRACE_END(TRACE_WAIT, wait_start);
+    if (result <= 0)
+        return result;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    CommandUsage collected;
+    collected.exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    collected.wall_time = (now.tv_sec - started_at->tv_sec) + (now.tv_nsec - started_at->tv_nsec) / 1e9;
+    collected.user_time = timeval_seconds(&rusage.ru_utime);
+    collected.sys_time = timeval_seconds(&rusage.ru_stime);
+    collected.max_rss_kb = rusage.ru_maxrss;
+
+    record_usage(name, &collected);
+    if (usage)
+        *usage = collected;
+    return result;
+}
+
+// a scheduled task that falls due during a long foreground command is fired on time instead of at the next prompt
+static void wait_firing_tasks(pid_t pid) {
+#ifdef SYS_pidfd_open
+    if (next_task_timeout_ms() < 0)
+        return;
+    int fd = syscall(SYS_pidfd_open, pid, 0);
+    if (fd < 0)
+        return;
+    struct pollfd pfd = {fd, POLLIN, 0};
+    int timeout;
+    while ((timeout = next_task_timeout_ms()) >= 0) {
+        int ready = poll(&pfd, 1, timeout);
+        if (ready > 0 || (ready < 0 && errno != EINTR))
+            break;
+        if (ready == 0) {
+            task_scheduler();
+            reap_tasks();
+        }
+    }
+    close(fd);
+#else
+    (void)pid;
+#endif
+}
+
+// reap_command for foreground children, which also set $? and count towards 'time'
+pid_t wait_command(pid_t pid, int options, const char *name, const struct timespec *started_at, CommandUsage *usage) {
+    if (!(options & WNOHANG) && pid > 0)
+        wait_firing_tasks(pid);
+    CommandUsage collected;
+    pid_t result = reap_command(pid, options, name, started_at, &collected);
+    if (result <= 0)
+        return result;
+
+    last_usage = collected;
+    window_usage.exit_status = collected.exit_status;
+    window_usage.user_time += collected.user_time;
+    window_usage.sys_time += collected.sys_time;
+    if (collected.max_rss_kb > window_usage.max_rss_kb)
+        window_usage.max_rss_kb = collected.max_rss_kb;
+    if (usage)
+        *usage = collected;
+    return result;
+}
+
+// builtins have no child to wait for, only their status is tracked
+void record_builtin_status(int exit_status) {
+    memset(&last_usage, 0, sizeof(last_usage));
+    last_usage.exit_status = exit_status;
+    window_usage.exit_status = exit_status;
+}
+
+int last_exit_status() {
+    return last_usage.exit_status;
+}
+
+// window_usage sums every child waited for since the last call, used by 'time'
+void begin_usage_window() {
+    memset(&window_usage, 0, sizeof(window_usage));
+}
+
+CommandUsage usage_window_total() {
+    return window_usage;
+}
+
+// $? and friends; returns NULL for names that are not status variables
+const char *status_variable(const char *name) {
+    static char status[16], real[32], user[32], sys[32], rss[32];
+
+    if (strcmp(name, "?") == 0) {
+        snprintf(status, sizeof(status), "%d", last_usage.exit_status);
+        return status;
+    }
+    if (strcmp(name, "LAST_REAL") == 0) {
+        snprintf(real, sizeof(real), "%.6f", last_usage.wall_time);
+        return real;
+    }
+    if (strcmp(name, "LAST_USER") == 0) {
+        snprintf(user, sizeof(user), "%.6f", last_usage.user_time);
+        return user;
+    }
+    if (strcmp(name, "LAST_SYS") == 0) {
+        snprintf(sys, sizeof(sys), "%.6f", last_usage.sys_time);
+        return sys;
+    }
+    if (strcmp(name, "LAST_MAXRSS") == 0) {
+        snprintf(rss, sizeof(rss), "%ld", last_usage.max_rss_kb);
+        return rss;
+    }
+    return NULL;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile_95(const double *samples, int count) {
+    double sorted[STATS_WINDOW];
+    memcpy(sorted, samples, count * sizeof(double));
+    qsort(sorted, count, sizeof(double), compare_doubles);
+    int index = (int)(0.95 * count + 0.999999) - 1;
+    return sorted[index < 0 ? 0 : index];
+}
+
+static void print_entry(const CommandStats *entry) {
+    int samples = entry->count < STATS_WINDOW ? (int)entry->count : STATS_WINDOW;
+    printf("%-16s %7lu %10.4f %10.4f %10.4f %10.4f %10.0f %10.0f\n", entry->name, entry->count,
+           entry->total_wall / entry->count, percentile_95(entry->wall_samples, samples),
+           entry->total_cpu / entry->count, percentile_95(entry->cpu_samples, samples),
+           entry->total_rss_kb / entry->count, percentile_95(entry->rss_samples, samples));
+}
+
+void print_command_stats(const char *name) {
+    printf("%-16s %7s %10s %10s %10s %10s %10s %10s\n", "COMMAND", "COUNT", "WALL(s)", "P95", "CPU(s)", "P95", "RSS(KB)", "P95");
+    if (name) {
+        CommandStats *entry = find_stats(name, false);
+        if (entry)
+            print_entry(entry);
+        return;
+    }
+    for (int i = 0; i < STATS_TABLE_SIZE; i++) {
+        if (stats_table[i].count > 0)
+            print_entry(&stats_table[i]);
+    }
+}
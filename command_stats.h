@@ -0,0 +1,57 @@
+#ifndef COMMAND_STATS_H
+#define COMMAND_STATS_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "trace.h"
+
+#define STATS_TABLE_SIZE 256
+#define STATS_WINDOW 64
+#define STATS_NAME_SIZE 64
+
+typedef struct {
+    int exit_status;
+    double wall_time;
+    double user_time;
+    double sys_time;
+    long max_rss_kb;
+} CommandUsage;
+
+typedef struct {
+    char name[STATS_NAME_SIZE];
+    unsigned long count;
+    double total_wall;
+    double total_cpu;
+    double total_rss_kb;
+    // last STATS_WINDOW runs, used for the p95 columns
+    double wall_samples[STATS_WINDOW];
+    double cpu_samples[STATS_WINDOW];
+    double rss_samples[STATS_WINDOW];
+    int next_sample;
+} CommandStats;
+
+pid_t reap_command(pid_t pid, int options, const char *name, const struct timespec *started_at, CommandUsage *usage);
+pid_t wait_command(pid_t pid, int options, const char *name, const struct timespec *started_at, CommandUsage *usage);
+void record_builtin_status(int exit_status);
+int last_exit_status();
+void begin_usage_window();
+CommandUsage usage_window_total();
+const char *status_variable(const char *name);
+void print_command_stats(const char *name);
+
+#endif
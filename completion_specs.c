@@ -0,0 +1,437 @@
+#include "completion_specs.h"
+#include "command_cache.h"
+
+static const char *completion_map = NULL;
+static size_t completion_map_size = 0;
+static bool completion_loaded = false;
+
+static uint64_t fnv_hash(const void *data, size_t length, uint64_t hash) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static uint32_t hash_key(const char *key, size_t length) {
+    return (uint32_t)fnv_hash(key, length, 1469598103934665603ull);
+}
+
+// the specs shipped next to the executable, then the user's own
+static int spec_dirs(char dirs[][COMPLETION_PATH_SIZE]) {
+    int count = 0;
+    char exe[COMPLETION_PATH_SIZE];
+    ssize_t n = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (n > 0) {
+        exe[n] = '\0';
+        snprintf(dirs[count++], COMPLETION_PATH_SIZE, "%.*s/%s", COMPLETION_PATH_SIZE / 2, dirname(exe), COMPLETION_SPEC_DIR);
+    }
+    const char *config = getenv("XDG_CONFIG_HOME");
+    const char *home = getenv("HOME");
+    if (config && *config)
+        snprintf(dirs[count++], COMPLETION_PATH_SIZE, "%.*s/%s", COMPLETION_PATH_SIZE / 2, config, COMPLETION_USER_DIR);
+    else if (home && *home)
+        snprintf(dirs[count++], COMPLETION_PATH_SIZE, "%.*s/.config/%s", COMPLETION_PATH_SIZE / 2, home, COMPLETION_USER_DIR);
+    return count;
+}
+
+static bool cache_path(char *path, size_t size) {
+    const char *cache = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    if (cache && *cache)
+        snprintf(path, size, "%s/%s", cache, COMPLETION_CACHE_FILE);
+    else if (home && *home)
+        snprintf(path, size, "%s/.cache/%s", home, COMPLETION_CACHE_FILE);
+    else
+        return false;
+    return true;
+}
+
+static bool is_spec_file(const char *name) {
+    size_t length = strlen(name), suffix = strlen(COMPLETION_SPEC_SUFFIX);
+    return name[0] != '.' && length > suffix && strcmp(name + length - suffix, COMPLETION_SPEC_SUFFIX) == 0;
+}
+
+// changes whenever a spec file is added, removed or edited; costs a directory read and a stat per file
+static uint64_t sources_signature(char dirs[][COMPLETION_PATH_SIZE], int dir_count) {
+    uint64_t signature = 0;
+    for (int d = 0; d < dir_count; d++) {
+        DIR *dir = opendir(dirs[d]);
+        if (!dir)
+            continue;
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            struct stat st;
+            if (!is_spec_file(entry->d_name) || fstatat(dirfd(dir), entry->d_name, &st, 0) == -1)
+                continue;
+            uint64_t hash = fnv_hash(dirs[d], strlen(dirs[d]), 1469598103934665603ull);
+            hash = fnv_hash(entry->d_name, strlen(entry->d_name), hash);
+            hash = fnv_hash(&st.st_mtim, sizeof(st.st_mtim), hash);
+            hash = fnv_hash(&st.st_size, sizeof(st.st_size), hash);
+            // summed so that the order readdir returns files in does not matter
+            signature += hash;
+        }
+        closedir(dir);
+    }
+    return signature;
+}
+
+static void *grow(void *data, size_t size) {
+    data = realloc(data, size);
+    if (!data) {
+        perror("Memory error");
+        exit(EXIT_FAILURE);
+    }
+    return data;
+}
+
+static SpecEntry *spec_entry(SpecSet *set, const char *key) {
+    for (size_t i = 0; i < set->count; i++) {
+        if (strcmp(set->entries[i].key, key) == 0)
+            return &set->entries[i];
+    }
+    if (set->count == set->capacity) {
+        set->capacity = set->capacity ? set->capacity * 2 : 64;
+        set->entries = grow(set->entries, set->capacity * sizeof(SpecEntry));
+    }
+    SpecEntry *entry = &set->entries[set->count++];
+    memset(entry, 0, sizeof(*entry));
+    entry->key = strdup(key);
+    return entry;
+}
+
+static void spec_add_word(SpecEntry *entry, const char *word) {
+    if (entry->word_count == entry->word_capacity) {
+        entry->word_capacity = entry->word_capacity ? entry->word_capacity * 2 : 16;
+        entry->words = grow(entry->words, entry->word_capacity * sizeof(char *));
+    }
+    entry->words[entry->word_count++] = strdup(word);
+}
+
+// "git commit : --amend -m" lines; the left side is normalised to single spaces
+static void parse_spec_file(SpecSet *set, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return;
+    char *line = NULL;
+    size_t size = 0;
+    int number = 0;
+    while (getline(&line, &size, file) != -1) {
+        number++;
+        char *comment = strchr(line, '#');
+        if (comment)
+            *comment = '\0';
+        char *separator = strstr(line, " : ");
+        if (!separator) {
+            if (strspn(line, " \t\r\n") != strlen(line))
+                fprintf(stderr, "%s:%d: expected '<command> : <words>'\n", path, number);
+            continue;
+        }
+        *separator = '\0';
+
+        char key[COMPLETION_PATH_SIZE] = "";
+        size_t key_length = 0;
+        for (char *word = strtok(line, " \t"); word; word = strtok(NULL, " \t")) {
+            key_length += snprintf(key + key_length, sizeof(key) - key_length, "%s%s", key_length ? " " : "", word);
+            if (key_length >= sizeof(key))
+                break;
+        }
+        if (key_length == 0 || key_length >= sizeof(key))
+            continue;
+        SpecEntry *entry = spec_entry(set, key);
+        for (char *word = strtok(separator + 3, " \t\r\n"); word; word = strtok(NULL, " \t\r\n"))
+            spec_add_word(entry, word);
+    }
+    free(line);
+    fclose(file);
+}
+
+static int compare_words(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static uint32_t buffer_add(SpecBuffer *buffer, const char *text) {
+    size_t length = strlen(text) + 1;
+    if (buffer->length + length > buffer->capacity) {
+        buffer->capacity = buffer->capacity ? buffer->capacity * 2 : 4096;
+        while (buffer->capacity < buffer->length + length)
+            buffer->capacity *= 2;
+        buffer->data = grow(buffer->data, buffer->capacity);
+    }
+    memcpy(buffer->data + buffer->length, text, length);
+    buffer->length += length;
+    return (uint32_t)(buffer->length - length);
+}
+
+static int write_all(int fd, const void *data, size_t length) {
+    const char *bytes = data;
+    while (length > 0) {
+        ssize_t n = write(fd, bytes, length);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        bytes += n;
+        length -= n;
+    }
+    return 0;
+}
+
+// parse every spec file and write the lookup tables next to each other, replacing the old file atomically
+static int compile_specs(char dirs[][COMPLETION_PATH_SIZE], int dir_count, uint64_t signature, const char *path) {
+    SpecSet set = {NULL, 0, 0};
+    for (int d = 0; d < dir_count; d++) {
+        DIR *dir = opendir(dirs[d]);
+        if (!dir)
+            continue;
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (!is_spec_file(entry->d_name))
+                continue;
+            char spec_path[COMPLETION_PATH_SIZE];
+            if (snprintf(spec_path, sizeof(spec_path), "%s/%s", dirs[d], entry->d_name) < (int)sizeof(spec_path))
+                parse_spec_file(&set, spec_path);
+        }
+        closedir(dir);
+    }
+
+    size_t word_total = 0;
+    for (size_t i = 0; i < set.count; i++) {
+        SpecEntry *entry = &set.entries[i];
+        qsort(entry->words, entry->word_count, sizeof(char *), compare_words);
+        size_t unique = 0;
+        for (size_t w = 0; w < entry->word_count; w++) {
+            if (unique > 0 && strcmp(entry->words[unique - 1], entry->words[w]) == 0)
+                free(entry->words[w]);
+            else
+                entry->words[unique++] = entry->words[w];
+        }
+        entry->word_count = unique;
+        word_total += unique;
+    }
+
+    CompletionHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, COMPLETION_MAGIC, sizeof(header.magic));
+    header.signature = signature;
+    header.bucket_count = 16;
+    while (header.bucket_count < set.count * 2)
+        header.bucket_count *= 2;
+    header.entry_count = set.count;
+    header.word_count = word_total;
+    header.buckets_offset = sizeof(header);
+    header.entries_offset = header.buckets_offset + header.bucket_count * sizeof(uint32_t);
+    header.words_offset = header.entries_offset + header.entry_count * sizeof(CompletionEntry);
+    header.strings_offset = header.words_offset + header.word_count * sizeof(uint32_t);
+
+    uint32_t *buckets = grow(NULL, header.bucket_count * sizeof(uint32_t));
+    CompletionEntry *entries = grow(NULL, (set.count + 1) * sizeof(CompletionEntry));
+    uint32_t *words = grow(NULL, (word_total + 1) * sizeof(uint32_t));
+    SpecBuffer strings = {NULL, 0, 0};
+    memset(buckets, 0xff, header.bucket_count * sizeof(uint32_t));
+
+    uint32_t next_word = 0;
+    for (size_t i = 0; i < set.count; i++) {
+        SpecEntry *spec = &set.entries[i];
+        uint32_t bucket = hash_key(spec->key, strlen(spec->key)) & (header.bucket_count - 1);
+        entries[i].key = buffer_add(&strings, spec->key);
+        entries[i].next = buckets[bucket];
+        entries[i].first_word = next_word;
+        entries[i].word_count = spec->word_count;
+        buckets[bucket] = i;
+        for (size_t w = 0; w < spec->word_count; w++) {
+            words[next_word++] = buffer_add(&strings, spec->words[w]);
+            free(spec->words[w]);
+        }
+        free(spec->words);
+        free(spec->key);
+    }
+    free(set.entries);
+    header.file_size = header.strings_offset + strings.length;
+
+    int result = -1;
+    char directory[COMPLETION_PATH_SIZE], temp_path[COMPLETION_PATH_SIZE + 16];
+    snprintf(directory, sizeof(directory), "%s", path);
+    make_dirs(dirname(directory));
+    snprintf(temp_path, sizeof(temp_path), "%s.XXXXXX", path);
+    int fd = mkstemp(temp_path);
+    if (fd >= 0) {
+        if (write_all(fd, &header, sizeof(header)) == 0 &&
+            write_all(fd, buckets, header.bucket_count * sizeof(uint32_t)) == 0 &&
+            write_all(fd, entries, header.entry_count * sizeof(CompletionEntry)) == 0 &&
+            write_all(fd, words, header.word_count * sizeof(uint32_t)) == 0 &&
+            write_all(fd, strings.data, strings.length) == 0)
+            result = 0;
+        close(fd);
+        if (result == 0 && rename(temp_path, path) == -1)
+            result = -1;
+        if (result != 0)
+            unlink(temp_path);
+    }
+    if (result != 0)
+        fprintf(stderr, "Failed to write completion cache %s: %s\n", path, strerror(errno));
+
+    free(buckets);
+    free(entries);
+    free(words);
+    free(strings.data);
+    return result;
+}
+
+static bool region_fits(uint64_t offset, uint64_t count, uint64_t size, uint64_t file_size) {
+    return offset <= file_size && count <= (file_size - offset) / size;
+}
+
+// everything find_entry and complete_arguments follow must stay inside the file, a bad cache is rebuilt
+static bool cache_is_valid(const char *data, uint64_t file_size) {
+    const CompletionHeader *header = (const CompletionHeader *)data;
+    if (header->bucket_count == 0 || (header->bucket_count & (header->bucket_count - 1)) != 0)
+        return false;
+    if (!region_fits(header->buckets_offset, header->bucket_count, sizeof(uint32_t), file_size) ||
+        !region_fits(header->entries_offset, header->entry_count, sizeof(CompletionEntry), file_size) ||
+        !region_fits(header->words_offset, header->word_count, sizeof(uint32_t), file_size) ||
+        header->buckets_offset % sizeof(uint32_t) != 0 || header->entries_offset % sizeof(uint32_t) != 0 ||
+        header->words_offset % sizeof(uint32_t) != 0 || header->strings_offset > file_size)
+        return false;
+
+    // strings are read with strcmp, so the string table has to end in a terminator
+    uint64_t strings_length = file_size - header->strings_offset;
+    if (header->entry_count > 0 && (strings_length == 0 || data[file_size - 1] != '\0'))
+        return false;
+
+    const uint32_t *buckets = (const uint32_t *)(data + header->buckets_offset);
+    const CompletionEntry *entries = (const CompletionEntry *)(data + header->entries_offset);
+    const uint32_t *words = (const uint32_t *)(data + header->words_offset);
+    for (uint32_t i = 0; i < header->bucket_count; i++) {
+        if (buckets[i] != COMPLETION_NONE && buckets[i] >= header->entry_count)
+            return false;
+    }
+    for (uint32_t i = 0; i < header->entry_count; i++) {
+        // chains always point to earlier entries, which also rules out loops
+        if ((entries[i].next != COMPLETION_NONE && entries[i].next >= i) || entries[i].key >= strings_length ||
+            (uint64_t)entries[i].first_word + entries[i].word_count > header->word_count)
+            return false;
+    }
+    for (uint32_t i = 0; i < header->word_count; i++) {
+        if (words[i] >= strings_length)
+            return false;
+    }
+    return true;
+}
+
+static bool map_cache(const char *path, uint64_t signature) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(CompletionHeader)) {
+        close(fd);
+        return false;
+    }
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    const CompletionHeader *header = data;
+    if (memcmp(header->magic, COMPLETION_MAGIC, sizeof(header->magic)) != 0 || header->signature != signature ||
+        header->file_size != (uint64_t)st.st_size || !cache_is_valid(data, st.st_size)) {
+        munmap(data, st.st_size);
+        return false;
+    }
+    if (completion_map)
+        munmap((void *)completion_map, completion_map_size);
+    completion_map = data;
+    completion_map_size = st.st_size;
+    return true;
+}
+
+// Map the compiled specs, compiling them first when a spec file changed since the last run
+void completion_specs_load() {
+    completion_loaded = true;
+    char dirs[2][COMPLETION_PATH_SIZE];
+    char path[COMPLETION_PATH_SIZE];
+    if (!cache_path(path, sizeof(path)))
+        return;
+    int dir_count = spec_dirs(dirs);
+    uint64_t signature = sources_signature(dirs, dir_count);
+    if (map_cache(path, signature))
+        return;
+    if (compile_specs(dirs, dir_count, signature, path) == 0)
+        map_cache(path, signature);
+}
+
+static const CompletionEntry *find_entry(const char *key, size_t length) {
+    const CompletionHeader *header = (const CompletionHeader *)completion_map;
+    const uint32_t *buckets = (const uint32_t *)(completion_map + header->buckets_offset);
+    const CompletionEntry *entries = (const CompletionEntry *)(completion_map + header->entries_offset);
+    const char *strings = completion_map + header->strings_offset;
+
+    uint32_t i = buckets[hash_key(key, length) & (header->bucket_count - 1)];
+    for (; i != COMPLETION_NONE; i = entries[i].next) {
+        const char *candidate = strings + entries[i].key;
+        if (strncmp(candidate, key, length) == 0 && candidate[length] == '\0')
+            return &entries[i];
+    }
+    return NULL;
+}
+
+// Print the words that can follow line, returns false when its command has no spec
+bool complete_arguments(const char *line) {
+    // the specs are mapped on the first Tab rather than at startup
+    if (!completion_loaded)
+        completion_specs_load();
+    if (!completion_map)
+        return false;
+    char copy[COMPLETION_PATH_SIZE];
+    snprintf(copy, sizeof(copy), "%s", line);
+    char *words[COMPLETION_MAX_WORDS];
+    int count = 0;
+    for (char *word = strtok(copy, " "); word && count < COMPLETION_MAX_WORDS; word = strtok(NULL, " "))
+        words[count++] = word;
+
+    // the last word is the one being completed unless the line ends in a space
+    const char *prefix = "";
+    int context = count;
+    size_t line_length = strlen(line);
+    if (count > 0 && line_length > 0 && line[line_length - 1] != ' ')
+        prefix = words[--context];
+    if (context == 0)
+        return false;
+
+    char key[COMPLETION_PATH_SIZE];
+    size_t key_length = snprintf(key, sizeof(key), "%s", words[0]);
+    const CompletionEntry *entry = find_entry(key, key_length);
+    if (!entry)
+        return false;
+    // follow subcommands that have a spec of their own, anything else (options, paths) is skipped
+    for (int i = 1; i < context; i++) {
+        size_t length = key_length + 1 + strlen(words[i]);
+        if (length >= sizeof(key))
+            break;
+        key[key_length] = ' ';
+        strcpy(key + key_length + 1, words[i]);
+        const CompletionEntry *deeper = find_entry(key, length);
+        if (deeper) {
+            entry = deeper;
+            key_length = length;
+        }
+        key[key_length] = '\0';
+    }
+
+    const CompletionHeader *header = (const CompletionHeader *)completion_map;
+    const uint32_t *candidates = (const uint32_t *)(completion_map + header->words_offset) + entry->first_word;
+    const char *strings = completion_map + header->strings_offset;
+    size_t low = 0, high = entry->word_count, prefix_length = strlen(prefix);
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        if (strcmp(strings + candidates[middle], prefix) < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    for (; low < entry->word_count && strncmp(strings + candidates[low], prefix, prefix_length) == 0; low++)
+        printf("%s\n", strings + candidates[low]);
+    return true;
+}
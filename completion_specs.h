@@ -0,0 +1,75 @@
+#ifndef COMPLETION_SPECS_H
+#define COMPLETION_SPECS_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define COMPLETION_MAGIC "CSHCMP1"
+#define COMPLETION_SPEC_DIR "completions"
+#define COMPLETION_USER_DIR "custom_shell/completions"
+#define COMPLETION_CACHE_FILE "custom_shell/completions.bin"
+#define COMPLETION_SPEC_SUFFIX ".spec"
+#define COMPLETION_NONE UINT32_MAX
+#define COMPLETION_MAX_WORDS 64
+#define COMPLETION_PATH_SIZE 4096
+
+// layout of the compiled file: header, buckets, entries, words, strings; offsets are from the start of the file
+typedef struct {
+    char magic[8];
+    uint64_t signature;
+    uint32_t file_size;
+    uint32_t bucket_count;
+    uint32_t entry_count;
+    uint32_t word_count;
+    uint32_t buckets_offset;
+    uint32_t entries_offset;
+    uint32_t words_offset;
+    uint32_t strings_offset;
+} CompletionHeader;
+
+// one "command subcommand..." context, its words are sorted so a prefix is found by binary search
+typedef struct {
+    uint32_t key;
+    uint32_t next;
+    uint32_t first_word;
+    uint32_t word_count;
+} CompletionEntry;
+
+// only used while compiling the spec files
+typedef struct {
+    char *key;
+    char **words;
+    size_t word_count;
+    size_t word_capacity;
+} SpecEntry;
+
+typedef struct {
+    SpecEntry *entries;
+    size_t count;
+    size_t capacity;
+} SpecSet;
+
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} SpecBuffer;
+
+void completion_specs_load();
+bool complete_arguments(const char *line);
+
+#endif
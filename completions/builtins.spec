@@ -0,0 +1,10 @@
+# Argument completion for the shell's own builtins, same format as git.spec.
+
+schedule : list
+focusmode : enable disable status
+jobs : -j -k
+trace : on off reset dump
+sysusage : --watch -n -c
+onchange : -d -k -c --
+cached : --ttl --env --input --refresh
+parallel : -j :::
@@ -0,0 +1,19 @@
+# Argument completion for docker, same format as git.spec.
+
+docker : attach build commit compose container cp create exec image images info inspect kill login logout logs network ps pull push restart rm rmi run start stats stop system tag top volume
+docker : --help --version --context --host --log-level
+docker build : --build-arg --file --no-cache --platform --pull --quiet --tag --target -f -t
+docker compose : build config down exec logs ps pull restart run start stop up
+docker compose up : --build --detach --force-recreate --no-deps --remove-orphans -d
+docker container : inspect kill logs ls prune restart rm start stop
+docker exec : --detach --env --interactive --tty --user --workdir -e -it -u -w
+docker image : build inspect ls prune pull push rm tag
+docker images : --all --digests --filter --format --quiet -a -q
+docker logs : --follow --since --tail --timestamps --until -f -n
+docker network : connect create disconnect inspect ls prune rm
+docker ps : --all --filter --format --last --latest --quiet --size -a -q
+docker rm : --force --volumes -f -v
+docker rmi : --force --no-prune -f
+docker run : --detach --entrypoint --env --env-file --interactive --mount --name --network --publish --restart --rm --tty --user --volume --workdir -d -e -it -p -v -w
+docker system : df events info prune
+docker volume : create inspect ls prune rm
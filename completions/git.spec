@@ -0,0 +1,24 @@
+# Argument completion for git.
+# Each line is "<command> [<subcommand>...] : <word>...". Lines with the same
+# left-hand side are merged, '#' starts a comment.
+
+git : add am bisect blame branch checkout cherry-pick clean clone commit config describe diff fetch grep init log merge mv pull push rebase reflog remote reset restore revert rm show stash status switch tag worktree
+git : --help --version -C -c --no-pager
+git add : --all --patch --update --force --dry-run --intent-to-add
+git branch : --all --delete --force --list --move --remotes --show-current --set-upstream-to --verbose
+git checkout : -b -B --detach --force --orphan --patch --track
+git clone : --branch --depth --bare --mirror --recurse-submodules --single-branch --shallow-submodules
+git commit : --all --amend --fixup --message --no-edit --no-verify --patch --signoff --squash -m -a
+git diff : --cached --name-only --name-status --stat --staged --word-diff --check
+git fetch : --all --prune --tags --depth --unshallow
+git log : --all --author --decorate --graph --name-only --oneline --patch --since --stat --until -n
+git merge : --abort --continue --ff-only --no-ff --squash --no-commit
+git pull : --rebase --no-rebase --ff-only --autostash --tags
+git push : --all --delete --dry-run --force --force-with-lease --set-upstream --tags -u origin
+git rebase : --abort --autosquash --continue --interactive --onto --skip -i
+git remote : add remove rename set-url show prune -v
+git reset : --hard --mixed --soft --keep --merge
+git restore : --source --staged --worktree --patch
+git stash : apply branch clear drop list pop push show
+git switch : --create --detach --force-create --orphan -c
+git tag : --annotate --delete --list --message --sign -a -d -l -m
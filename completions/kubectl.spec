@@ -0,0 +1,14 @@
+# Argument completion for kubectl, same format as git.spec.
+
+kubectl : annotate api-resources apply attach auth config cordon cp create delete describe diff drain edit exec explain expose get label logs patch port-forward rollout run scale top uncordon version
+kubectl : --context --kubeconfig --namespace -n
+kubectl apply : --dry-run --filename --kustomize --prune --recursive --server-side -f -k
+kubectl config : current-context get-contexts set-context use-context view
+kubectl delete : --all --filename --force --grace-period --selector -f -l configmap deployment job namespace pod secret service
+kubectl describe : configmap deployment ingress job namespace node pod secret service statefulset
+kubectl exec : --container --stdin --tty -c -it
+kubectl get : --all-namespaces --output --selector --show-labels --watch -A -l -o -w configmaps cronjobs deployments events ingresses jobs namespaces nodes pods replicasets secrets services statefulsets
+kubectl logs : --all-containers --container --follow --previous --since --tail --timestamps -c -f -p
+kubectl rollout : history pause restart resume status undo
+kubectl scale : --replicas --current-replicas
+kubectl top : node pod
@@ -0,0 +1,220 @@
+#include "copy_engine.h"
+#include "command_stats.h"
+
+// errors that mean "this mechanism does not work for these fds", not a real I/O failure
+static bool should_fall_back(int error) {
+    return error == EINVAL || error == ENOSYS || error == EXDEV || error == EOPNOTSUPP || error == EBADF;
+}
+
+// each stage returns 1 when it reached EOF, 0 to try the next stage, -1 on error
+static int copy_with_range(int in_fd, int out_fd, ssize_t *total) {
+    while (1) {
+        ssize_t n = copy_file_range(in_fd, NULL, out_fd, NULL, COPY_CHUNK_SIZE, 0);
+        if (n == 0)
+            return 1;
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return should_fall_back(errno) ? 0 : -1;
+        }
+        *total += n;
+    }
+}
+
+static int copy_with_sendfile(int in_fd, int out_fd, ssize_t *total) {
+    while (1) {
+        ssize_t n = sendfile(out_fd, in_fd, NULL, COPY_CHUNK_SIZE);
+        if (n == 0)
+            return 1;
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return should_fall_back(errno) ? 0 : -1;
+        }
+        *total += n;
+    }
+}
+
+static int copy_with_splice(int in_fd, int out_fd, ssize_t *total) {
+    while (1) {
+        ssize_t n = splice(in_fd, NULL, out_fd, NULL, COPY_PIPE_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n == 0)
+            return 1;
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return should_fall_back(errno) ? 0 : -1;
+        }
+        *total += n;
+    }
+}
+
+static int copy_with_buffer(int in_fd, int out_fd, ssize_t *total) {
+    char *buffer = malloc(COPY_BUFFER_SIZE);
+    if (!buffer)
+        return -1;
+
+    int result = 1;
+    while (1) {
+        ssize_t n = read(in_fd, buffer, COPY_BUFFER_SIZE);
+        if (n == 0)
+            break;
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            result = -1;
+            break;
+        }
+        ssize_t written = 0;
+        while (written < n) {
+            ssize_t w = write(out_fd, buffer + written, n - written);
+            if (w < 0) {
+                if (errno == EINTR)
+                    continue;
+                result = -1;
+                break;
+            }
+            written += w;
+        }
+        if (result < 0)
+            break;
+        *total += n;
+    }
+    free(buffer);
+    return result;
+}
+
+// Copy in_fd to out_fd from their current offsets to EOF, keeping the data in the kernel when possible.
+// A stage that turns out not to support the pair hands over to the next one where it stopped.
+ssize_t copy_fd(int in_fd, int out_fd) {
+    struct stat in_stat, out_stat;
+    ssize_t total = 0;
+    int result = 0;
+
+    if (fstat(in_fd, &in_stat) == -1 || fstat(out_fd, &out_stat) == -1)
+        return -1;
+
+    if (S_ISREG(in_stat.st_mode) && S_ISREG(out_stat.st_mode))
+        result = copy_with_range(in_fd, out_fd, &total);
+    if (result == 0 && S_ISREG(in_stat.st_mode))
+        result = copy_with_sendfile(in_fd, out_fd, &total);
+    if (result == 0 && (S_ISFIFO(in_stat.st_mode) || S_ISFIFO(out_stat.st_mode)))
+        result = copy_with_splice(in_fd, out_fd, &total);
+    if (result == 0)
+        result = copy_with_buffer(in_fd, out_fd, &total);
+
+    return result < 0 ? -1 : total;
+}
+
+// Copy src to dest (or into dest when it is a directory), creating dest with src's permissions
+int copy_file(const char *src, const char *dest) {
+    // the source is checked before anything is opened, so a bad source never truncates the destination
+    struct stat src_stat, dest_stat;
+    if (stat(src, &src_stat) == -1) {
+        fprintf(stderr, "%s: %s\n", src, strerror(errno));
+        return -1;
+    }
+    if (S_ISDIR(src_stat.st_mode)) {
+        fprintf(stderr, "cp: omitting directory '%s'\n", src);
+        return -1;
+    }
+    if (!S_ISREG(src_stat.st_mode)) {
+        fprintf(stderr, "cp: '%s' is not a regular file\n", src);
+        return -1;
+    }
+    int in_fd = open(src, O_RDONLY | O_CLOEXEC);
+    if (in_fd < 0 || fstat(in_fd, &src_stat) == -1) {
+        fprintf(stderr, "%s: %s\n", src, strerror(errno));
+        if (in_fd >= 0)
+            close(in_fd);
+        return -1;
+    }
+
+    char *target = NULL;
+    if (stat(dest, &dest_stat) == 0) {
+        if (S_ISDIR(dest_stat.st_mode)) {
+            char *src_copy = strdup(src);
+            const char *base = basename(src_copy);
+            target = malloc(strlen(dest) + strlen(base) + 2);
+            sprintf(target, "%s/%s", dest, base);
+            free(src_copy);
+            if (stat(target, &dest_stat) != 0)
+                dest_stat.st_ino = 0;
+        }
+        if (dest_stat.st_dev == src_stat.st_dev && dest_stat.st_ino == src_stat.st_ino) {
+            fprintf(stderr, "%s and %s are the same file\n", src, dest);
+            free(target);
+            close(in_fd);
+            return -1;
+        }
+    }
+
+    // a new file only gets the source's permissions once the copy has succeeded
+    const char *path = target ? target : dest;
+    bool created = access(path, F_OK) != 0;
+    int out_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (out_fd < 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        free(target);
+        close(in_fd);
+        return -1;
+    }
+
+    ssize_t copied = copy_fd(in_fd, out_fd);
+    if (copied < 0)
+        fprintf(stderr, "Failed to copy %s to %s: %s\n", src, path, strerror(errno));
+    if (copied >= 0 && created)
+        fchmod(out_fd, src_stat.st_mode & 0777);
+    close(in_fd);
+    if (close(out_fd) == -1 && copied >= 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        copied = -1;
+    }
+    if (copied < 0 && created)
+        unlink(path);
+    free(target);
+    return copied < 0 ? -1 : 0;
+}
+
+void handle_cp(char **args, int arg_count) {
+    if (arg_count < 3) {
+        fprintf(stderr, "Usage: cp <source>... <destination>\n");
+        record_builtin_status(EXIT_FAILURE);
+        return;
+    }
+    struct stat dest_stat;
+    if (arg_count > 3 && (stat(args[arg_count - 1], &dest_stat) != 0 || !S_ISDIR(dest_stat.st_mode))) {
+        fprintf(stderr, "cp: target '%s' is not a directory\n", args[arg_count - 1]);
+        record_builtin_status(EXIT_FAILURE);
+        return;
+    }
+    for (int i = 1; i < arg_count - 1; i++) {
+        if (copy_file(args[i], args[arg_count - 1]) != 0)
+            record_builtin_status(EXIT_FAILURE);
+    }
+}
+
+void handle_cat(char **args, int arg_count) {
+    fflush(stdout);
+    if (arg_count < 2) {
+        if (copy_fd(STDIN_FILENO, STDOUT_FILENO) < 0) {
+            perror("cat");
+            record_builtin_status(EXIT_FAILURE);
+        }
+        return;
+    }
+    for (int i = 1; i < arg_count; i++) {
+        int fd = strcmp(args[i], "-") == 0 ? STDIN_FILENO : open(args[i], O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            fprintf(stderr, "cat: %s: %s\n", args[i], strerror(errno));
+            record_builtin_status(EXIT_FAILURE);
+            continue;
+        }
+        if (copy_fd(fd, STDOUT_FILENO) < 0) {
+            fprintf(stderr, "cat: %s: %s\n", args[i], strerror(errno));
+            record_builtin_status(EXIT_FAILURE);
+        }
+        if (fd != STDIN_FILENO)
+            close(fd);
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef COPY_ENGINE_H
+#define COPY_ENGINE_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+
+#define COPY_CHUNK_SIZE (1L << 30)
+#define COPY_PIPE_CHUNK (1 << 20)
+#define COPY_BUFFER_SIZE (128 * 1024)
+
+ssize_t copy_fd(int in_fd, int out_fd);
+int copy_file(const char *src, const char *dest);
+void handle_cp(char **args, int arg_count);
+void handle_cat(char **args, int arg_count);
+
+#endif
@@ -8,50 +8,77 @@ const char *BLOCKED_HOSTS[] = {
     "instagram.com",
 };
 
-void check_root() {
-    uid_t euid = geteuid(); 
-    if (euid != 0) {
+const char *hosts_path() {
+    const char *path = getenv(HOSTS_FILE_ENV);
+    return path ? path : HOSTS_FILE;
+}
+
+int check_root() {
+    if (access(hosts_path(), W_OK) != 0) {
         fprintf(stderr, "This script must be run as root\n");
-        return;
+        return 0;
     }
+    return 1;
 }
 
 void copy_contents(const char* src, const char* dest) {
-    FILE *src_file = fopen(src, "r");
-    FILE *dest_file = fopen(dest, "w");
-    if (!src_file || !dest_file) {
-        fprintf(stderr, "Couldn't open HOST OR BACKUP HOST file.\n");
+    if (copy_file(src, dest) != 0) {
+        fprintf(stderr, "Couldn't copy HOST OR BACKUP HOST file.\n");
         return;
     }
-    char c;
-    while ((c = fgetc(src_file)) != EOF) {
-        fputc(c, dest_file);
-    }
-    fclose(dest_file);
-    fclose(src_file);
     printf("Successfully backed up initial state.\n");
 }
 
-void enable_focus_mode() {
-    check_root();
-    FILE* hosts_file = fopen(HOSTS_FILE, "a");
-    if (!hosts_file) {
-        fprintf(stderr, "Failed to open hosts file\n");
+// one section per blocklist, named after the file so it can be toggled on its own
+static const char *section_name(const char *list_path) {
+    const char *base = strrchr(list_path, '/');
+    return base ? base + 1 : list_path;
+}
+
+void enable_focus_mode(char **lists, int list_count) {
+    if (!check_root()) {
+        record_builtin_status(EXIT_FAILURE);
         return;
     }
 
-    copy_contents(HOSTS_FILE, BACKUP_FILE);
+    // keep a copy of the untouched file the first time focus mode runs
+    if (strcmp(hosts_path(), HOSTS_FILE) == 0 && access(BACKUP_FILE, F_OK) != 0)
+        copy_contents(HOSTS_FILE, BACKUP_FILE);
 
-    printf("Adding blocked sites to /etc/hosts...\n");
-    for (int i = 0; i < BLOCKED_SITES; i++) {
-        fprintf(hosts_file, "127.0.0.1 %s\n", BLOCKED_HOSTS[i]);
+    int failed = 0;
+    if (list_count == 0) {
+        failed += blocklist_enable(hosts_path(), DEFAULT_SECTION, NULL, BLOCKED_HOSTS, BLOCKED_SITES) != 0;
+    }
+    for (int i = 0; i < list_count; i++) {
+        failed += blocklist_enable(hosts_path(), section_name(lists[i]), lists[i], NULL, 0) != 0;
+    }
+    if (failed) {
+        record_builtin_status(EXIT_FAILURE);
+        return;
     }
-
-    fclose(hosts_file);
     printf("Focus mode enabled.\n");
 }
 
-void disable_focus_mode() {
-    copy_contents(BACKUP_FILE, HOSTS_FILE);
+void disable_focus_mode(char **sections, int section_count) {
+    if (!check_root()) {
+        record_builtin_status(EXIT_FAILURE);
+        return;
+    }
+
+    int failed = 0;
+    if (section_count == 0) {
+        failed += blocklist_disable(hosts_path(), NULL) != 0;
+    }
+    for (int i = 0; i < section_count; i++) {
+        failed += blocklist_disable(hosts_path(), section_name(sections[i])) != 0;
+    }
+    if (failed) {
+        record_builtin_status(EXIT_FAILURE);
+        return;
+    }
     printf("Focus mode disabled.\n");
 }
+
+void focus_mode_status() {
+    blocklist_status(hosts_path());
+}
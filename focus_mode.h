@@ -5,14 +5,18 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include "copy_engine.h"
+#include "hosts_blocklist.h"
 
 #define HOSTS_FILE "/etc/hosts"
 #define BACKUP_FILE "/etc/hosts.backup"
+#define HOSTS_FILE_ENV "FOCUS_HOSTS_FILE"
+#define DEFAULT_SECTION "default"
 #define BLOCKED_SITES 5
 
-void enable_focus_mode();
+void enable_focus_mode(char **lists, int list_count);
 
-void disable_focus_mode();
+void disable_focus_mode(char **sections, int section_count);
 
 void focus_mode_status();
 
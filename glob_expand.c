@@ -0,0 +1,501 @@
+#include "glob_expand.h"
+#include "trace.h"
+
+static char dirents[GLOB_DIRENT_BUFFER];
+
+static void *grow(void *data, size_t size) {
+    data = realloc(data, size);
+    if (!data) {
+        perror("Memory error");
+        exit(EXIT_FAILURE);
+    }
+    return data;
+}
+
+// strings handed out to the command line stay alive until glob_end
+char *glob_keep_string(GlobExpansion *globs, char *text) {
+    if (globs->string_count == globs->string_capacity) {
+        globs->string_capacity = globs->string_capacity ? globs->string_capacity * 2 : 64;
+        globs->strings = grow(globs->strings, globs->string_capacity * sizeof(char *));
+    }
+    globs->strings[globs->string_count++] = text;
+    return text;
+}
+
+static bool has_glob_chars(const char *text, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        if (text[i] == '*' || text[i] == '?' || text[i] == '[')
+            return true;
+    }
+    return false;
+}
+
+// parses "[...]" at text into a 256 bit set, returns the length consumed or 0 when it is not closed
+static size_t compile_class(const char *text, size_t length, GlobOp *op) {
+    size_t i = 1;
+    bool negate = false;
+    if (i < length && (text[i] == '!' || text[i] == '^')) {
+        negate = true;
+        i++;
+    }
+    memset(op->class_bits, 0, sizeof(op->class_bits));
+    size_t first = i;
+    while (i < length && (text[i] != ']' || i == first)) {
+        unsigned int low = (unsigned char)text[i], high = low;
+        if (i + 2 < length && text[i + 1] == '-' && text[i + 2] != ']') {
+            high = (unsigned char)text[i + 2];
+            i += 3;
+        } else {
+            i++;
+        }
+        for (unsigned int c = low; c <= high; c++)
+            op->class_bits[c >> 3] |= 1 << (c & 7);
+    }
+    if (i >= length)
+        return 0;
+    if (negate) {
+        for (size_t b = 0; b < sizeof(op->class_bits); b++)
+            op->class_bits[b] = ~op->class_bits[b];
+    }
+    op->type = GLOB_CLASS;
+    return i + 1;
+}
+
+static void compile_component(GlobComponent *component, const char *text, size_t length) {
+    component->text = text;
+    component->text_length = length;
+    component->ops = grow(NULL, (length + 1) * sizeof(GlobOp));
+    component->op_count = 0;
+    component->suffix = NULL;
+    component->suffix_length = 0;
+    component->globstar = length == 2 && text[0] == '*' && text[1] == '*';
+    component->hidden = length > 0 && text[0] == '.';
+
+    GlobOp *ops = component->ops;
+    int count = 0;
+    for (size_t i = 0; i < length;) {
+        size_t used;
+        if (text[i] == '*') {
+            if (count == 0 || ops[count - 1].type != GLOB_STAR)
+                ops[count++].type = GLOB_STAR;
+            i++;
+        } else if (text[i] == '?') {
+            ops[count++].type = GLOB_ANY;
+            i++;
+        } else if (text[i] == '[' && (used = compile_class(text + i, length - i, &ops[count])) > 0) {
+            count++;
+            i += used;
+        } else if (count > 0 && ops[count - 1].type == GLOB_LITERAL) {
+            // literal runs are contiguous in the pattern, so extending the last one is enough
+            ops[count - 1].length++;
+            i++;
+        } else {
+            ops[count].type = GLOB_LITERAL;
+            ops[count].literal = text + i;
+            ops[count].length = 1;
+            count++;
+            i++;
+        }
+    }
+    component->op_count = count;
+    component->literal = count == 0 || (count == 1 && ops[0].type == GLOB_LITERAL);
+    // "*.log" style patterns reject most names on the suffix alone
+    if (count > 1 && ops[count - 1].type == GLOB_LITERAL) {
+        component->suffix = ops[count - 1].literal;
+        component->suffix_length = ops[count - 1].length;
+    }
+}
+
+// linear matcher, a mismatch only ever backs up to the most recent '*'
+static bool match_component(const GlobComponent *component, const char *name, size_t name_length) {
+    if (component->suffix && (name_length < component->suffix_length ||
+                              memcmp(name + name_length - component->suffix_length, component->suffix, component->suffix_length) != 0))
+        return false;
+
+    const GlobOp *ops = component->ops;
+    int op = 0, star_op = -1;
+    const char *s = name, *star_s = NULL;
+    while (1) {
+        if (op < component->op_count) {
+            const GlobOp *current = &ops[op];
+            unsigned char c = *s;
+            if (current->type == GLOB_STAR) {
+                star_op = ++op;
+                star_s = s;
+                continue;
+            }
+            if (current->type == GLOB_LITERAL && strncmp(s, current->literal, current->length) == 0) {
+                s += current->length;
+                op++;
+                continue;
+            }
+            if (current->type == GLOB_ANY && c) {
+                s++;
+                op++;
+                continue;
+            }
+            if (current->type == GLOB_CLASS && c && (current->class_bits[c >> 3] & (1 << (c & 7)))) {
+                s++;
+                op++;
+                continue;
+            }
+        } else if (*s == '\0') {
+            return true;
+        }
+        if (star_op < 0 || *star_s == '\0')
+            return false;
+        s = ++star_s;
+        op = star_op;
+    }
+}
+
+static uint64_t hash_path(const char *path) {
+    uint64_t hash = 1469598103934665603ull;
+    for (; *path; path++) {
+        hash ^= (unsigned char)*path;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static DirListing **dir_slot(DirListing **dirs, size_t capacity, const char *path) {
+    size_t mask = capacity - 1;
+    size_t i = hash_path(path) & mask;
+    while (dirs[i] && strcmp(dirs[i]->path, path) != 0)
+        i = (i + 1) & mask;
+    return &dirs[i];
+}
+
+// every directory is read at most once per command line, however many patterns walk through it
+static DirListing *read_dir(GlobExpansion *globs, const char *path) {
+    if ((globs->dir_count + 1) * 2 > globs->dir_capacity) {
+        size_t capacity = globs->dir_capacity ? globs->dir_capacity * 2 : 64;
+        DirListing **dirs = calloc(capacity, sizeof(DirListing *));
+        for (size_t i = 0; i < globs->dir_capacity; i++) {
+            if (globs->dirs[i])
+                *dir_slot(dirs, capacity, globs->dirs[i]->path) = globs->dirs[i];
+        }
+        free(globs->dirs);
+        globs->dirs = dirs;
+        globs->dir_capacity = capacity;
+    }
+    DirListing **slot = dir_slot(globs->dirs, globs->dir_capacity, path);
+    if (*slot)
+        return *slot;
+
+    DirListing *listing = calloc(1, sizeof(DirListing));
+    listing->path = strdup(path);
+    *slot = listing;
+    globs->dir_count++;
+
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        return listing;
+    size_t names_capacity = 0, entry_capacity = 0;
+    while (1) {
+        long n = syscall(SYS_getdents64, fd, dirents, sizeof(dirents));
+        if (n <= 0)
+            break;
+        for (long offset = 0; offset < n;) {
+            struct dirent64 *entry = (struct dirent64 *)(dirents + offset);
+            offset += entry->d_reclen;
+            const char *name = entry->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+                continue;
+
+            size_t length = strlen(name) + 1;
+            if (listing->names_length + length > names_capacity) {
+                names_capacity = names_capacity ? names_capacity * 2 : 65536;
+                while (names_capacity < listing->names_length + length)
+                    names_capacity *= 2;
+                listing->names = grow(listing->names, names_capacity);
+            }
+            if (listing->count == entry_capacity) {
+                entry_capacity = entry_capacity ? entry_capacity * 2 : 1024;
+                listing->offsets = grow(listing->offsets, entry_capacity * sizeof(uint32_t));
+                listing->types = grow(listing->types, entry_capacity);
+            }
+            memcpy(listing->names + listing->names_length, name, length);
+            listing->offsets[listing->count] = listing->names_length;
+            listing->types[listing->count] = entry->d_type;
+            listing->count++;
+            listing->names_length += length;
+        }
+    }
+    close(fd);
+    return listing;
+}
+
+static size_t listing_name_length(const DirListing *listing, size_t index) {
+    size_t end = index + 1 < listing->count ? listing->offsets[index + 1] : listing->names_length;
+    return end - listing->offsets[index] - 1;
+}
+
+// d_type answers this for nearly every entry, stat is only needed for links and unknown types
+static bool entry_is_dir(const DirListing *listing, size_t index, const char *path, bool follow_links) {
+    unsigned char type = listing->types[index];
+    if (type == DT_DIR)
+        return true;
+    if (type != DT_UNKNOWN && !(type == DT_LNK && follow_links))
+        return false;
+    struct stat st;
+    int result = follow_links ? stat(path, &st) : lstat(path, &st);
+    return result == 0 && S_ISDIR(st.st_mode);
+}
+
+// appends a name to walk->path, returns the new length or 0 when the path gets too long
+static size_t path_append(char *path, size_t length, const char *name, size_t name_length) {
+    if (length > 0 && path[length - 1] != '/')
+        path[length++] = '/';
+    if (length + name_length + 2 >= GLOB_PATH_SIZE)
+        return 0;
+    memcpy(path + length, name, name_length);
+    path[length + name_length] = '\0';
+    return length + name_length;
+}
+
+static void add_match(GlobWalk *walk, size_t length) {
+    GlobMatches *matches = walk->matches;
+    if (walk->dir_only) {
+        struct stat st;
+        if (stat(walk->path, &st) == -1 || !S_ISDIR(st.st_mode))
+            return;
+    }
+    if (matches->count == matches->limit) {
+        matches->overflow = true;
+        return;
+    }
+    if (matches->count == matches->capacity) {
+        matches->capacity = matches->capacity ? matches->capacity * 2 : 64;
+        matches->items = grow(matches->items, matches->capacity * sizeof(char *));
+    }
+    char *match = grow(NULL, length + 2);
+    memcpy(match, walk->path, length);
+    if (walk->dir_only)
+        match[length++] = '/';
+    match[length] = '\0';
+    matches->items[matches->count++] = match;
+}
+
+static void walk_path(GlobWalk *walk, int index, size_t length) {
+    if (walk->matches->overflow)
+        return;
+    if (index == walk->count) {
+        add_match(walk, length);
+        return;
+    }
+
+    GlobComponent *component = &walk->components[index];
+    bool last = index + 1 == walk->count;
+    if (component->literal) {
+        // no need to list the directory, the name is either there or not
+        size_t next = path_append(walk->path, length, component->text, component->text_length);
+        struct stat st;
+        if (next > 0 && !last)
+            walk_path(walk, index + 1, next);
+        else if (next > 0 && lstat(walk->path, &st) == 0)
+            add_match(walk, next);
+        walk->path[length] = '\0';
+        return;
+    }
+
+    DirListing *listing = read_dir(walk->globs, length == 0 ? "." : walk->path);
+    if (component->globstar && !last)
+        walk_path(walk, index + 1, length);
+    for (size_t i = 0; i < listing->count && !walk->matches->overflow; i++) {
+        const char *name = listing->names + listing->offsets[i];
+        size_t name_length = listing_name_length(listing, i);
+        if (name[0] == '.' && !component->hidden)
+            continue;
+        if (!component->globstar && !match_component(component, name, name_length))
+            continue;
+        size_t next = path_append(walk->path, length, name, name_length);
+        if (next == 0)
+            continue;
+
+        if (component->globstar) {
+            // "**" matches any number of directories, symlinks are not followed to avoid cycles
+            if (last)
+                add_match(walk, next);
+            if (entry_is_dir(listing, i, walk->path, false))
+                walk_path(walk, index, next);
+        } else if (last) {
+            add_match(walk, next);
+        } else if (entry_is_dir(listing, i, walk->path, true)) {
+            walk_path(walk, index + 1, next);
+        }
+        walk->path[length] = '\0';
+    }
+}
+
+static int compare_matches(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// expands one brace free word against the filesystem, words without matches are kept as they are
+static int glob_word(GlobExpansion *globs, char *word, char **out, int room) {
+    size_t length = strlen(word);
+    if (!has_glob_chars(word, length)) {
+        if (room < 1)
+            return -1;
+        out[0] = word;
+        return 1;
+    }
+
+    TRACE_BEGIN(glob_start);
+    GlobComponent components[GLOB_MAX_COMPONENTS];
+    GlobMatches matches = {NULL, 0, 0, room, false};
+    GlobWalk walk;
+    walk.globs = globs;
+    walk.components = components;
+    walk.count = 0;
+    walk.dir_only = word[length - 1] == '/';
+    walk.matches = &matches;
+    walk.path[0] = '\0';
+
+    const char *p = word;
+    size_t start = 0;
+    if (*p == '/') {
+        strcpy(walk.path, "/");
+        start = 1;
+    }
+    while (*p) {
+        while (*p == '/')
+            p++;
+        if (!*p || walk.count == GLOB_MAX_COMPONENTS)
+            break;
+        const char *end = strchr(p, '/');
+        size_t component_length = end ? (size_t)(end - p) : strlen(p);
+        compile_component(&components[walk.count++], p, component_length);
+        p += component_length;
+    }
+    if (!*p)
+        walk_path(&walk, 0, start);
+    for (int i = 0; i < walk.count; i++)
+        free(components[i].ops);
+    TRACE_END(TRACE_GLOB, glob_start);
+
+    if (matches.overflow) {
+        for (size_t i = 0; i < matches.count; i++)
+            free(matches.items[i]);
+        free(matches.items);
+        return -1;
+    }
+    if (matches.count == 0) {
+        free(matches.items);
+        if (room < 1)
+            return -1;
+        out[0] = word;
+        return 1;
+    }
+    qsort(matches.items, matches.count, sizeof(char *), compare_matches);
+    for (size_t i = 0; i < matches.count; i++)
+        out[i] = glob_keep_string(globs, matches.items[i]);
+    free(matches.items);
+    return (int)matches.count;
+}
+
+// the first '{' that has a matching '}' and a comma at its own level
+static bool find_brace_group(const char *word, size_t *open, size_t *close) {
+    for (size_t i = 0; word[i]; i++) {
+        if (word[i] != '{')
+            continue;
+        int depth = 0;
+        bool comma = false;
+        for (size_t j = i + 1; word[j]; j++) {
+            if (word[j] == '{') {
+                depth++;
+            } else if (word[j] == '}') {
+                if (depth == 0) {
+                    if (comma) {
+                        *open = i;
+                        *close = j;
+                        return true;
+                    }
+                    break;
+                }
+                depth--;
+            } else if (word[j] == ',' && depth == 0) {
+                comma = true;
+            }
+        }
+    }
+    return false;
+}
+
+// a{b,c}d -> abd acd, nested groups are expanded by recursing on each result
+static int expand_braces(GlobExpansion *globs, char *word, char **words, int *count) {
+    size_t open, close;
+    if (!find_brace_group(word, &open, &close)) {
+        if (*count == GLOB_MAX_WORDS)
+            return -1;
+        words[(*count)++] = word;
+        return 0;
+    }
+
+    size_t tail = strlen(word + close + 1);
+    size_t start = open + 1;
+    int depth = 0;
+    for (size_t i = open + 1; i <= close; i++) {
+        if (i < close && word[i] == '{') {
+            depth++;
+        } else if (i < close && word[i] == '}') {
+            depth--;
+        } else if (depth == 0 && (word[i] == ',' || i == close)) {
+            size_t alternative = i - start;
+            char *expanded = glob_keep_string(globs, grow(NULL, open + alternative + tail + 1));
+            memcpy(expanded, word, open);
+            memcpy(expanded + open, word + start, alternative);
+            memcpy(expanded + open + alternative, word + close + 1, tail + 1);
+            if (expand_braces(globs, expanded, words, count) != 0)
+                return -1;
+            start = i + 1;
+        }
+    }
+    return 0;
+}
+
+void glob_begin(GlobExpansion *globs) {
+    memset(globs, 0, sizeof(*globs));
+}
+
+// Expand braces and wildcards in word into out, returns the number of words or -1 when more than room
+int glob_expand(GlobExpansion *globs, char *word, char **out, int room) {
+    if (!strpbrk(word, "*?[{")) {
+        if (room < 1)
+            return -1;
+        out[0] = word;
+        return 1;
+    }
+
+    char *words[GLOB_MAX_WORDS];
+    int word_count = 0;
+    if (expand_braces(globs, word, words, &word_count) != 0)
+        return -1;
+    int total = 0;
+    for (int i = 0; i < word_count; i++) {
+        int expanded = glob_word(globs, words[i], out + total, room - total);
+        if (expanded < 0)
+            return -1;
+        total += expanded;
+    }
+    return total;
+}
+
+void glob_end(GlobExpansion *globs) {
+    for (size_t i = 0; i < globs->dir_capacity; i++) {
+        DirListing *listing = globs->dirs[i];
+        if (!listing)
+            continue;
+        free(listing->path);
+        free(listing->names);
+        free(listing->offsets);
+        free(listing->types);
+        free(listing);
+    }
+    free(globs->dirs);
+    for (size_t i = 0; i < globs->string_count; i++)
+        free(globs->strings[i]);
+    free(globs->strings);
+    memset(globs, 0, sizeof(*globs));
+}
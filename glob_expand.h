@@ -0,0 +1,95 @@
+#ifndef GLOB_EXPAND_H
+#define GLOB_EXPAND_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define GLOB_DIRENT_BUFFER (1 << 20)
+#define GLOB_MAX_WORDS 1024
+#define GLOB_MAX_COMPONENTS 64
+#define GLOB_PATH_SIZE 4096
+
+typedef enum {
+    GLOB_LITERAL,
+    GLOB_ANY,
+    GLOB_STAR,
+    GLOB_CLASS
+} glob_op_type;
+
+typedef struct {
+    glob_op_type type;
+    const char *literal;
+    size_t length;
+    uint8_t class_bits[32];
+} GlobOp;
+
+// one path component of a pattern, compiled once and matched against every directory entry
+typedef struct {
+    const char *text;
+    size_t text_length;
+    GlobOp *ops;
+    int op_count;
+    const char *suffix;
+    size_t suffix_length;
+    bool literal;
+    bool globstar;
+    bool hidden;
+} GlobComponent;
+
+// the entries of one directory, read once per command line
+typedef struct {
+    char *path;
+    char *names;
+    size_t names_length;
+    uint32_t *offsets;
+    unsigned char *types;
+    size_t count;
+} DirListing;
+
+typedef struct {
+    char **items;
+    size_t count;
+    size_t capacity;
+    size_t limit;
+    bool overflow;
+} GlobMatches;
+
+// state shared by every word of one command line
+typedef struct GlobExpansion {
+    DirListing **dirs;
+    size_t dir_capacity;
+    size_t dir_count;
+    char **strings;
+    size_t string_count;
+    size_t string_capacity;
+} GlobExpansion;
+
+// a pattern being matched, path holds the directory reached so far
+typedef struct {
+    GlobExpansion *globs;
+    GlobComponent *components;
+    int count;
+    bool dir_only;
+    GlobMatches *matches;
+    char path[GLOB_PATH_SIZE];
+} GlobWalk;
+
+void glob_begin(GlobExpansion *globs);
+int glob_expand(GlobExpansion *globs, char *word, char **out, int room);
+void glob_end(GlobExpansion *globs);
+char *glob_keep_string(GlobExpansion *globs, char *text);
+
+#endif
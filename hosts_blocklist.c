@@ -0,0 +1,376 @@
+#include "hosts_blocklist.h"
+#include <ctype.h>
+#include <time.h>
+
+typedef struct {
+    char *data;
+    size_t length;
+} MappedFile;
+
+static int map_file(const char *path, MappedFile *file) {
+    file->data = NULL;
+    file->length = 0;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return -1;
+    }
+    if (st.st_size > 0) {
+        file->data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (file->data == MAP_FAILED) {
+            fprintf(stderr, "%s: %s\n", path, strerror(errno));
+            close(fd);
+            file->data = NULL;
+            return -1;
+        }
+        madvise(file->data, st.st_size, MADV_SEQUENTIAL);
+        file->length = st.st_size;
+    }
+    close(fd);
+    return 0;
+}
+
+static void unmap_file(MappedFile *file) {
+    if (file->data)
+        munmap(file->data, file->length);
+}
+
+static bool next_line(const char *text, size_t length, size_t *pos, const char **line, size_t *line_length) {
+    if (*pos >= length)
+        return false;
+    const char *start = text + *pos;
+    const char *end = memchr(start, '\n', length - *pos);
+    size_t span = end ? (size_t)(end - start) : length - *pos;
+    *pos += span + (end ? 1 : 0);
+    if (span > 0 && start[span - 1] == '\r')
+        span--;
+    *line = start;
+    *line_length = span;
+    return true;
+}
+
+// splits the next whitespace separated field off the line, stopping at comments
+static bool next_field(const char **line, size_t *length, HostName *field) {
+    while (*length > 0 && isspace((unsigned char)**line)) {
+        (*line)++;
+        (*length)--;
+    }
+    if (*length == 0 || **line == '#')
+        return false;
+    field->text = *line;
+    while (*length > 0 && !isspace((unsigned char)**line) && **line != '#') {
+        (*line)++;
+        (*length)--;
+    }
+    field->length = *line - field->text;
+    return true;
+}
+
+// "# >>> focusmode NAME >>>" style markers, name points into the line
+static bool parse_marker(const char *line, size_t length, const char *prefix, HostName *name) {
+    size_t prefix_length = strlen(prefix);
+    if (length <= prefix_length || strncmp(line, prefix, prefix_length) != 0)
+        return false;
+    const char *rest = line + prefix_length;
+    size_t rest_length = length - prefix_length;
+    return next_field(&rest, &rest_length, name);
+}
+
+static bool section_matches(const HostName *name, const char *section) {
+    return section == NULL || (strlen(section) == name->length && strncmp(name->text, section, name->length) == 0);
+}
+
+static uint64_t hash_host(const HostName *name) {
+    uint64_t hash = 1469598103934665603ull;
+    for (size_t i = 0; i < name->length; i++) {
+        hash ^= (unsigned char)tolower((unsigned char)name->text[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static void host_set_init(HostSet *set, size_t expected) {
+    set->capacity = 1024;
+    while (set->capacity < expected * 2)
+        set->capacity *= 2;
+    set->size = 0;
+    set->slots = calloc(set->capacity, sizeof(HostName));
+}
+
+static HostName *host_set_slot(HostName *slots, size_t capacity, const HostName *name) {
+    size_t mask = capacity - 1;
+    size_t i = hash_host(name) & mask;
+    while (slots[i].text) {
+        if (slots[i].length == name->length && strncasecmp(slots[i].text, name->text, name->length) == 0)
+            return &slots[i];
+        i = (i + 1) & mask;
+    }
+    return &slots[i];
+}
+
+// returns false when the name was already present
+static bool host_set_add(HostSet *set, const HostName *name) {
+    if ((set->size + 1) * 2 > set->capacity) {
+        size_t capacity = set->capacity * 2;
+        HostName *slots = calloc(capacity, sizeof(HostName));
+        for (size_t i = 0; i < set->capacity; i++) {
+            if (set->slots[i].text)
+                *host_set_slot(slots, capacity, &set->slots[i]) = set->slots[i];
+        }
+        free(set->slots);
+        set->slots = slots;
+        set->capacity = capacity;
+    }
+    HostName *slot = host_set_slot(set->slots, set->capacity, name);
+    if (slot->text)
+        return false;
+    *slot = *name;
+    set->size++;
+    return true;
+}
+
+static void output_append(OutputBuffer *out, const char *data, size_t length) {
+    if (out->length + length > out->capacity) {
+        size_t capacity = out->capacity ? out->capacity : 65536;
+        while (capacity < out->length + length)
+            capacity *= 2;
+        out->data = realloc(out->data, capacity);
+        if (!out->data) {
+            perror("Memory error");
+            exit(EXIT_FAILURE);
+        }
+        out->capacity = capacity;
+    }
+    memcpy(out->data + out->length, data, length);
+    out->length += length;
+}
+
+static void output_append_str(OutputBuffer *out, const char *text) {
+    output_append(out, text, strlen(text));
+}
+
+// copy hosts to out without the sections being dropped, remembering every name that stays outside focusmode sections;
+// names in other sections are not remembered, each section keeps its own copy so disabling one never unblocks another
+static void filter_hosts(const MappedFile *hosts, const char *drop_section, OutputBuffer *out, HostSet *present) {
+    size_t pos = 0;
+    const char *line;
+    size_t length;
+    bool dropping = false;
+    bool other_section = false;
+
+    while (next_line(hosts->data, hosts->length, &pos, &line, &length)) {
+        HostName name;
+        if (!dropping && parse_marker(line, length, SECTION_BEGIN, &name) && section_matches(&name, drop_section)) {
+            dropping = true;
+            continue;
+        }
+        if (dropping) {
+            if (parse_marker(line, length, SECTION_END, &name))
+                dropping = false;
+            continue;
+        }
+
+        if (parse_marker(line, length, SECTION_BEGIN, &name))
+            other_section = true;
+        else if (parse_marker(line, length, SECTION_END, &name))
+            other_section = false;
+
+        output_append(out, line, length);
+        output_append(out, "\n", 1);
+        if (present && !other_section) {
+            HostName field;
+            const char *rest = line;
+            size_t rest_length = length;
+            if (!next_field(&rest, &rest_length, &field))
+                continue;
+            while (next_field(&rest, &rest_length, &field))
+                host_set_add(present, &field);
+        }
+    }
+}
+
+// write to a temporary file next to path and rename it over path, so readers see old or new but never half
+static int replace_file_atomically(const char *path, const OutputBuffer *out) {
+    struct stat st;
+    if (stat(path, &st) == -1) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    char *dir_copy = strdup(path);
+    char *base_copy = strdup(path);
+    char temp_path[4096];
+    snprintf(temp_path, sizeof(temp_path), "%s/.%s.focusmode.XXXXXX", dirname(dir_copy), basename(base_copy));
+    free(dir_copy);
+    free(base_copy);
+
+    int fd = mkstemp(temp_path);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to create temporary hosts file: %s\n", strerror(errno));
+        return -1;
+    }
+    fchmod(fd, st.st_mode & 07777);
+    if (fchown(fd, st.st_uid, st.st_gid) == -1) {
+        // only root can hand the file to another owner, keeping ours is fine otherwise
+    }
+
+    size_t written = 0;
+    while (written < out->length) {
+        ssize_t n = write(fd, out->data + written, out->length - written);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        written += n;
+    }
+    if (written < out->length || fsync(fd) == -1 || close(fd) == -1) {
+        fprintf(stderr, "Failed to write temporary hosts file: %s\n", strerror(errno));
+        unlink(temp_path);
+        return -1;
+    }
+    if (rename(temp_path, path) == -1) {
+        // EBUSY here usually means path is a bind mount (containers), which cannot be replaced atomically
+        fprintf(stderr, "Failed to replace %s: %s, it was left unchanged\n", path, strerror(errno));
+        unlink(temp_path);
+        return -1;
+    }
+    return 0;
+}
+
+static double elapsed_ms(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static void append_blocked(OutputBuffer *out, HostSet *present, const HostName *name, size_t *added, size_t *skipped) {
+    if (!host_set_add(present, name)) {
+        (*skipped)++;
+        return;
+    }
+    output_append_str(out, BLOCK_ADDRESS " ");
+    output_append(out, name->text, name->length);
+    output_append(out, "\n", 1);
+    (*added)++;
+}
+
+// (Re)build the named section from a blocklist file (plain domains or hosts format) or the builtin list
+int blocklist_enable(const char *hosts_path, const char *section, const char *list_path, const char **builtin, int builtin_count) {
+    struct timespec started_at;
+    clock_gettime(CLOCK_MONOTONIC, &started_at);
+
+    MappedFile hosts, list = {NULL, 0};
+    if (map_file(hosts_path, &hosts) != 0)
+        return -1;
+    if (list_path && map_file(list_path, &list) != 0) {
+        unmap_file(&hosts);
+        return -1;
+    }
+
+    OutputBuffer out = {NULL, 0, 0};
+    HostSet present;
+    host_set_init(&present, (hosts.length + list.length) / 16);
+    filter_hosts(&hosts, section, &out, &present);
+
+    size_t added = 0, skipped = 0;
+    output_append_str(&out, SECTION_BEGIN);
+    output_append_str(&out, section);
+    output_append_str(&out, " >>>\n");
+    if (list_path) {
+        size_t pos = 0;
+        const char *line;
+        size_t length;
+        while (next_line(list.data, list.length, &pos, &line, &length)) {
+            HostName first, second;
+            if (!next_field(&line, &length, &first))
+                continue;
+            if (!next_field(&line, &length, &second)) {
+                append_blocked(&out, &present, &first, &added, &skipped);
+                continue;
+            }
+            // hosts format: everything after the address is a name
+            do {
+                append_blocked(&out, &present, &second, &added, &skipped);
+            } while (next_field(&line, &length, &second));
+        }
+    } else {
+        for (int i = 0; i < builtin_count; i++) {
+            HostName name = {builtin[i], strlen(builtin[i])};
+            append_blocked(&out, &present, &name, &added, &skipped);
+        }
+    }
+    output_append_str(&out, SECTION_END);
+    output_append_str(&out, section);
+    output_append_str(&out, " <<<\n");
+
+    int result = replace_file_atomically(hosts_path, &out);
+    if (result == 0)
+        printf("Blocked %zu domains in section '%s' (%zu duplicates skipped) in %.2f ms\n", added, section, skipped, elapsed_ms(&started_at));
+
+    free(out.data);
+    free(present.slots);
+    unmap_file(&list);
+    unmap_file(&hosts);
+    return result;
+}
+
+// Remove the named section, or every focusmode section when section is NULL
+int blocklist_disable(const char *hosts_path, const char *section) {
+    struct timespec started_at;
+    clock_gettime(CLOCK_MONOTONIC, &started_at);
+
+    MappedFile hosts;
+    if (map_file(hosts_path, &hosts) != 0)
+        return -1;
+    OutputBuffer out = {NULL, 0, 0};
+    filter_hosts(&hosts, section, &out, NULL);
+
+    int result = 0;
+    if (out.length != hosts.length) {
+        result = replace_file_atomically(hosts_path, &out);
+        if (result == 0)
+            printf("Removed %s in %.2f ms\n", section ? section : "all focusmode sections", elapsed_ms(&started_at));
+    } else {
+        printf("Nothing to remove.\n");
+    }
+    free(out.data);
+    unmap_file(&hosts);
+    return result;
+}
+
+void blocklist_status(const char *hosts_path) {
+    MappedFile hosts;
+    if (map_file(hosts_path, &hosts) != 0)
+        return;
+
+    size_t pos = 0, entries = 0;
+    const char *line;
+    size_t length;
+    HostName name;
+    bool inside = false, any = false;
+    while (next_line(hosts.data, hosts.length, &pos, &line, &length)) {
+        if (!inside && parse_marker(line, length, SECTION_BEGIN, &name)) {
+            inside = true;
+            entries = 0;
+            printf("%.*s: ", (int)name.length, name.text);
+        } else if (inside && parse_marker(line, length, SECTION_END, &name)) {
+            inside = false;
+            any = true;
+            printf("%zu domains blocked\n", entries);
+        } else if (inside) {
+            entries++;
+        }
+    }
+    if (inside)
+        printf("%zu domains blocked, missing end marker\n", entries);
+    if (!any && !inside)
+        printf("Focus mode is disabled.\n");
+    unmap_file(&hosts);
+}
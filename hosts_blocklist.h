@@ -0,0 +1,47 @@
+#ifndef HOSTS_BLOCKLIST_H
+#define HOSTS_BLOCKLIST_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define BLOCK_ADDRESS "127.0.0.1"
+#define SECTION_BEGIN "# >>> focusmode "
+#define SECTION_END "# <<< focusmode "
+
+// a view into a loaded file, never copied
+typedef struct {
+    const char *text;
+    size_t length;
+} HostName;
+
+typedef struct {
+    HostName *slots;
+    size_t capacity;
+    size_t size;
+} HostSet;
+
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} OutputBuffer;
+
+int blocklist_enable(const char *hosts_path, const char *section, const char *list_path, const char **builtin, int builtin_count);
+int blocklist_disable(const char *hosts_path, const char *section);
+void blocklist_status(const char *hosts_path);
+
+#endif
@@ -0,0 +1,353 @@
+#include "job_queue.h"
+#include "variables.h"
+
+Job jobs[MAX_JOBS];
+int job_count = 0;
+
+// min-heap of indices into jobs[], ordered by priority then submission order
+int run_queue[MAX_JOBS];
+int queue_size = 0;
+unsigned long submit_seq[MAX_JOBS];
+unsigned long next_seq = 0;
+
+int max_running = 1;
+int running_count = 0;
+int online_cpus = 1;
+bool slot_busy[MAX_JOBS];
+int wake_pipe[2] = {-1, -1};
+
+static void sigchld_handler(int sig) {
+    (void)sig;
+    int saved_errno = errno;
+    char c = 0;
+    if (write(wake_pipe[1], &c, 1) < 0) {
+        // pipe full means a wakeup is already pending
+    }
+    errno = saved_errno;
+}
+
+// The wakeup pipe and SIGCHLD handler are set up on first use, so a shell that never queues a job doesn't pay for them
+void job_queue_init() {
+    if (wake_pipe[0] >= 0)
+        return;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    online_cpus = cpus > 0 ? (int)cpus : 1;
+    max_running = online_cpus;
+
+    if (pipe(wake_pipe) == -1) {
+        perror("Failed to create job wakeup pipe");
+        return;
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(wake_pipe[i], F_SETFL, fcntl(wake_pipe[i], F_GETFL) | O_NONBLOCK);
+        fcntl(wake_pipe[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigchld_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &sa, NULL);
+}
+
+int job_queue_wake_fd() {
+    job_queue_init();
+    return wake_pipe[0];
+}
+
+int get_max_running() {
+    job_queue_init();
+    return max_running;
+}
+
+void set_max_running(int limit) {
+    job_queue_init();
+    if (limit < 1 || limit > MAX_JOBS) {
+        fprintf(stderr, "Job limit must be between 1 and %d\n", MAX_JOBS);
+        return;
+    }
+    max_running = limit;
+    dispatch_jobs();
+}
+
+static bool queue_before(int a, int b) {
+    if (jobs[a].priority != jobs[b].priority)
+        return jobs[a].priority < jobs[b].priority;
+    return submit_seq[a] < submit_seq[b];
+}
+
+static void queue_swap(int i, int j) {
+    int temp = run_queue[i];
+    run_queue[i] = run_queue[j];
+    run_queue[j] = temp;
+}
+
+static void queue_push(int job_index) {
+    int i = queue_size++;
+    run_queue[i] = job_index;
+    while (i > 0 && queue_before(run_queue[i], run_queue[(i - 1) / 2])) {
+        queue_swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void queue_sift_down(int i) {
+    while (1) {
+        int left = 2 * i + 1;
+        int right = 2 * i + 2;
+        int first = i;
+        if (left < queue_size && queue_before(run_queue[left], run_queue[first]))
+            first = left;
+        if (right < queue_size && queue_before(run_queue[right], run_queue[first]))
+            first = right;
+        if (first == i)
+            break;
+        queue_swap(i, first);
+        i = first;
+    }
+}
+
+static int queue_pop() {
+    int root = run_queue[0];
+    run_queue[0] = run_queue[--queue_size];
+    queue_sift_down(0);
+    return root;
+}
+
+// take a job out of the middle of the heap, the entry moved into its place may have to go either way
+static bool queue_remove(int job_index) {
+    for (int i = 0; i < queue_size; i++) {
+        if (run_queue[i] != job_index)
+            continue;
+        run_queue[i] = run_queue[--queue_size];
+        while (i > 0 && queue_before(run_queue[i], run_queue[(i - 1) / 2])) {
+            queue_swap(i, (i - 1) / 2);
+            i = (i - 1) / 2;
+        }
+        queue_sift_down(i);
+        return true;
+    }
+    return false;
+}
+
+static double elapsed_seconds(const struct timespec *from, const struct timespec *to) {
+    return (to->tv_sec - from->tv_sec) + (to->tv_nsec - from->tv_nsec) / 1e9;
+}
+
+// runs in the child: apply the job's priority and pin it to its core slot
+static void apply_job_priority(const Job *job) {
+    if (job->priority >= PRIORITY_IDLE) {
+        struct sched_param param = {0};
+        if (sched_setscheduler(0, SCHED_IDLE, &param) == -1)
+            perror("Failed to set idle scheduling");
+    } else if (setpriority(PRIO_PROCESS, 0, job->priority) == -1) {
+        perror("Failed to set job priority");
+    }
+
+    // the slot picks a core out of the ones the shell itself may run on (taskset, cgroup cpusets)
+    cpu_set_t allowed, cpus;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1 || CPU_COUNT(&allowed) == 0)
+        return;
+    int skip = job->slot % CPU_COUNT(&allowed);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed) || skip-- > 0)
+            continue;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        // pinning is only an optimisation, the job runs unpinned if it is refused
+        sched_setaffinity(0, sizeof(cpus), &cpus);
+        break;
+    }
+}
+
+static void start_job(int job_index) {
+    Job *job = &jobs[job_index];
+    int slot = 0;
+    while (slot_busy[slot])
+        slot++;
+
+    job->slot = slot;
+    char **envp = variable_envp();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("Failed to fork");
+        job->status = TERMINATED;
+        job->slot = -1;
+        clock_gettime(CLOCK_MONOTONIC, &job->finished_at);
+        return;
+    }
+    if (pid == 0) {
+        char command[MAX_INPUT];
+        char *args[MAX_ARGUMENTS];
+        int arg_count = 0;
+        strcpy(command, job->command);
+        char *token = strtok(command, " ");
+        while (token != NULL && arg_count < MAX_ARGUMENTS - 1) {
+            args[arg_count++] = token;
+            token = strtok(NULL, " ");
+        }
+        args[arg_count] = NULL;
+
+        signal(SIGCHLD, SIG_DFL);
+        setpgid(0, 0);
+        int devnull = open("/dev/null", O_RDONLY);
+        if (devnull >= 0) {
+            dup2(devnull, STDIN_FILENO);
+            close(devnull);
+        }
+        apply_job_priority(job);
+        execvpe(args[0], args, envp);
+        perror("Failed to execute command");
+        _exit(EXIT_FAILURE);
+    }
+
+    slot_busy[slot] = true;
+    running_count++;
+    job->pid = pid;
+    job->status = RUNNING;
+    clock_gettime(CLOCK_MONOTONIC, &job->started_at);
+}
+
+void dispatch_jobs() {
+    while (running_count < max_running && queue_size > 0) {
+        start_job(queue_pop());
+    }
+}
+
+void submit_job(const char *command, int priority) {
+    job_queue_init();
+    int index = 0;
+    while (index < job_count && !(jobs[index].status == TERMINATED && jobs[index].reported))
+        index++;
+    if (index == MAX_JOBS) {
+        fprintf(stderr, "Job limit reached, run 'jobs' to clear finished jobs.\n");
+        return;
+    }
+    if (index == job_count)
+        job_count++;
+
+    if (priority < PRIORITY_MIN)
+        priority = PRIORITY_MIN;
+    if (priority > PRIORITY_IDLE)
+        priority = PRIORITY_IDLE;
+
+    Job *job = &jobs[index];
+    memset(job, 0, sizeof(*job));
+    job->job_id = index + 1;
+    job->status = QUEUED;
+    job->priority = priority;
+    job->slot = -1;
+    strncpy(job->command, command, MAX_INPUT - 1);
+    clock_gettime(CLOCK_MONOTONIC, &job->queued_at);
+
+    submit_seq[index] = next_seq++;
+    queue_push(index);
+    printf("[%d] queued (priority %d)\n", job->job_id, priority);
+    dispatch_jobs();
+}
+
+void reap_jobs() {
+    // the pipe only exists once job_queue_init() has run, and nothing can have been queued before that
+    char drain[64];
+    while (wake_pipe[0] >= 0 && read(wake_pipe[0], drain, sizeof(drain)) > 0)
+        ;
+
+    for (int i = 0; i < job_count; i++) {
+        if (jobs[i].status != RUNNING && jobs[i].status != STOPPED)
+            continue;
+        char name[MAX_INPUT] = "";
+        sscanf(jobs[i].command, "%254s", name);
+        if (reap_command(jobs[i].pid, WNOHANG, name, &jobs[i].started_at, NULL) != jobs[i].pid)
+            continue;
+        jobs[i].status = TERMINATED;
+        clock_gettime(CLOCK_MONOTONIC, &jobs[i].finished_at);
+        slot_busy[jobs[i].slot] = false;
+        jobs[i].slot = -1;
+        running_count--;
+    }
+    dispatch_jobs();
+}
+
+// jobs that are queued or running, stopped jobs don't count as they only move on when resumed
+int unfinished_jobs() {
+    int count = 0;
+    for (int i = 0; i < job_count; i++) {
+        if (jobs[i].status == QUEUED || jobs[i].status == RUNNING)
+            count++;
+    }
+    return count;
+}
+
+void list_jobs() {
+    job_queue_init();
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    reap_jobs();
+
+    for (int i = 0; i < job_count; i++) {
+        Job *job = &jobs[i];
+        if (job->status == TERMINATED && job->reported)
+            continue;
+
+        double wait_time, run_time = 0;
+        const char *state;
+        switch (job->status) {
+            case QUEUED:
+                state = YEL "Queued" RESET;
+                wait_time = elapsed_seconds(&job->queued_at, &now);
+                break;
+            case RUNNING:
+            case STOPPED:
+                state = job->status == RUNNING ? GRN "Running" RESET : RED "Stopped" RESET;
+                wait_time = elapsed_seconds(&job->queued_at, &job->started_at);
+                run_time = elapsed_seconds(&job->started_at, &now);
+                break;
+            default:
+                state = BLU "Done" RESET;
+                wait_time = elapsed_seconds(&job->queued_at, &job->started_at);
+                run_time = elapsed_seconds(&job->started_at, &job->finished_at);
+                job->reported = true;
+                break;
+        }
+        printf("[%d] %s (%d) %s prio=%d wait=%.2fs run=%.2fs\n", job->job_id, job->command, job->pid, state, job->priority, wait_time, run_time);
+    }
+    printf("%d running, %d queued, limit %d\n", running_count, queue_size, max_running);
+}
+
+void suspend_job(int job_id) {
+    if (job_id < 1 || job_id > job_count || jobs[job_id - 1].status != RUNNING) {
+        fprintf(stderr, "No running job %d\n", job_id);
+        return;
+    }
+    pid_t pid = jobs[job_id - 1].pid;
+
+    if (kill(pid, SIGTSTP) == -1) {
+        perror("Failed to suspend job.");
+        return;
+    }
+    jobs[job_id - 1].status = STOPPED;
+    printf("Job %d (%s) suspended\n", job_id, jobs[job_id - 1].command);
+}
+
+void kill_job(int job_id) {
+    if (job_id >= 1 && job_id <= job_count && jobs[job_id - 1].status == QUEUED && queue_remove(job_id - 1)) {
+        Job *job = &jobs[job_id - 1];
+        job->status = TERMINATED;
+        clock_gettime(CLOCK_MONOTONIC, &job->finished_at);
+        job->started_at = job->finished_at;
+        printf("Job %d (%s) removed from the queue\n", job_id, job->command);
+        return;
+    }
+    if (job_id < 1 || job_id > job_count || (jobs[job_id - 1].status != RUNNING && jobs[job_id - 1].status != STOPPED)) {
+        fprintf(stderr, "No running job %d\n", job_id);
+        return;
+    }
+    pid_t pid = jobs[job_id - 1].pid;
+
+    if (kill(pid, SIGKILL) == -1) {
+        perror("Failed to kill the job.");
+        return;
+    }
+    printf("Job %d (%s) kill\n", job_id, jobs[job_id - 1].command);
+}
@@ -0,0 +1,43 @@
+#ifndef JOB_QUEUE_H
+#define JOB_QUEUE_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "shell.h"
+#include "command_stats.h"
+
+// priorities follow nice(2): lower runs first, PRIORITY_IDLE maps to SCHED_IDLE
+#define PRIORITY_DEFAULT 0
+#define PRIORITY_MIN -20
+#define PRIORITY_IDLE 20
+
+extern Job jobs[MAX_JOBS];
+extern int job_count;
+
+void job_queue_init();
+int job_queue_wake_fd();
+void set_max_running(int limit);
+int get_max_running();
+void submit_job(const char *command, int priority);
+void dispatch_jobs();
+void reap_jobs();
+int unfinished_jobs();
+void list_jobs();
+void suspend_job(int job_id);
+void kill_job(int job_id);
+
+#endif
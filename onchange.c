@@ -0,0 +1,298 @@
+#include "onchange.h"
+#include "shell.h"
+#include "auto_delete.h"
+#include "job_queue.h"
+#include "task_scheduler.h"
+#include "command_stats.h"
+
+static double monotonic_ms() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+static int add_watch(WatchSet *set, const char *path) {
+    int wd = inotify_add_watch(set->fd, path, ONCHANGE_MASK);
+    if (wd < 0) {
+        fprintf(stderr, "onchange: cannot watch %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (wd >= set->capacity) {
+        int capacity = set->capacity ? set->capacity : 64;
+        while (capacity <= wd)
+            capacity *= 2;
+        set->paths = realloc(set->paths, capacity * sizeof(char *));
+        memset(set->paths + set->capacity, 0, (capacity - set->capacity) * sizeof(char *));
+        set->capacity = capacity;
+    }
+    if (set->paths[wd]) {
+        free(set->paths[wd]);
+    } else {
+        set->count++;
+    }
+    set->paths[wd] = strdup(path);
+    return wd;
+}
+
+// hidden directories such as .git change on their own and are left out
+static bool watch_directory(const char *path, const struct stat *st, void *context) {
+    if (!S_ISDIR(st->st_mode))
+        return false;
+    const char *name = strrchr(path, '/');
+    if (name && name[1] == '.')
+        return false;
+    add_watch(context, path);
+    return true;
+}
+
+static int watch_tree(WatchSet *set, const char *path) {
+    if (add_watch(set, path) < 0)
+        return -1;
+    if (isDirectory(path))
+        walk_directory(path, watch_directory, set);
+    return 0;
+}
+
+static void close_watches(WatchSet *set) {
+    for (int i = 0; i < set->capacity; i++)
+        free(set->paths[i]);
+    free(set->paths);
+    close(set->fd);
+}
+
+// watch directories created while events were being dropped; path is copied since add_watch replaces the stored one
+static void rescan_watches(WatchSet *set) {
+    int capacity = set->capacity;
+    for (int wd = 0; wd < capacity; wd++) {
+        if (!set->paths[wd] || !isDirectory(set->paths[wd]))
+            continue;
+        char *path = strdup(set->paths[wd]);
+        walk_directory(path, watch_directory, set);
+        free(path);
+    }
+}
+
+// reads every queued event, returns how many of them are changes worth a rerun
+static int read_events(WatchSet *set) {
+    char buffer[ONCHANGE_EVENT_BUFFER] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int changes = 0;
+    bool overflowed = false;
+    ssize_t n;
+    while ((n = read(set->fd, buffer, sizeof(buffer))) > 0) {
+        for (char *p = buffer; p < buffer + n;) {
+            struct inotify_event *event = (struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {
+                // events were dropped, so new directories may have gone unwatched
+                overflowed = true;
+                changes++;
+                continue;
+            }
+            const char *parent = event->wd >= 0 && event->wd < set->capacity ? set->paths[event->wd] : NULL;
+            if (!parent)
+                continue;
+
+            if (event->mask & IN_IGNORED) {
+                // the watched path itself went away; editors that save by renaming bring it straight back
+                char *path = set->paths[event->wd];
+                set->paths[event->wd] = NULL;
+                set->count--;
+                if (access(path, F_OK) == 0)
+                    watch_tree(set, path);
+                free(path);
+                continue;
+            }
+            if (event->len > 0 && event->name[0] == '.')
+                continue;
+            if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+                char path[4096];
+                snprintf(path, sizeof(path), "%s/%s", parent, event->name);
+                watch_tree(set, path);
+            }
+            changes++;
+        }
+    }
+    if (overflowed)
+        rescan_watches(set);
+    return changes;
+}
+
+// the command runs in a forked copy of the shell with its own process group, so it can be stopped as a whole
+static pid_t start_run(const char *line) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("Failed to fork");
+        return -1;
+    }
+    if (pid == 0) {
+        setpgid(0, 0);
+        char *command = strdup(line);
+        exec_command(command);
+        fflush(stdout);
+        _exit(last_exit_status());
+    }
+    setpgid(pid, pid);
+    return pid;
+}
+
+static void report_run(const char *line, const struct timespec *started_at) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double seconds = (now.tv_sec - started_at->tv_sec) + (now.tv_nsec - started_at->tv_nsec) / 1e9;
+    fprintf(stderr, "onchange: '%s' exited with %d after %.2fs\n", line, last_exit_status(), seconds);
+}
+
+static void stop_run(pid_t pid, const struct timespec *started_at) {
+    killpg(pid, SIGTERM);
+    double deadline = monotonic_ms() + ONCHANGE_KILL_GRACE_MS;
+    while (wait_command(pid, WNOHANG, "onchange", started_at, NULL) == 0) {
+        if (monotonic_ms() >= deadline) {
+            killpg(pid, SIGKILL);
+            wait_command(pid, 0, "onchange", started_at, NULL);
+            break;
+        }
+        struct timespec delay = {0, 10 * 1000 * 1000};
+        nanosleep(&delay, NULL);
+    }
+}
+
+// onchange [-d ms] [-k] [-c count] path... -- command, reached through run_builtin with the command already expanded;
+// the shell normally calls run_onchange with the text after '--' as typed instead
+void handle_onchange(char **args, int arg_count) {
+    int separator = 1;
+    while (separator < arg_count && strcmp(args[separator], "--") != 0)
+        separator++;
+    char line[MAX_INPUT] = "";
+    for (int j = separator + 1; j < arg_count; j++) {
+        if (strlen(line) + strlen(args[j]) + 1 >= MAX_INPUT) {
+            fprintf(stderr, "onchange: command is too long\n");
+            record_builtin_status(EXIT_FAILURE);
+            return;
+        }
+        strcat(line, args[j]);
+        if (j < arg_count - 1)
+            strcat(line, " ");
+    }
+    run_onchange(args, separator, separator < arg_count ? line : NULL);
+}
+
+// args holds the options and paths up to '--', command is the rest of the line, expanded afresh on every run
+void run_onchange(char **args, int arg_count, const char *command) {
+    int debounce = ONCHANGE_DEBOUNCE_MS;
+    int runs_left = -1;
+    onchange_mode mode = ONCHANGE_QUEUE;
+    int i = 1;
+    for (; i < arg_count && args[i][0] == '-'; i++) {
+        if (strcmp(args[i], "-k") == 0) {
+            mode = ONCHANGE_RESTART;
+        } else if (strcmp(args[i], "-d") == 0 && i + 1 < arg_count) {
+            debounce = atoi(args[++i]);
+        } else if (strcmp(args[i], "-c") == 0 && i + 1 < arg_count) {
+            runs_left = atoi(args[++i]);
+        } else {
+            break;
+        }
+    }
+    while (command && *command == ' ')
+        command++;
+    if (i == arg_count || !command || *command == '\0') {
+        fprintf(stderr, "Usage: onchange [-d ms] [-k] [-c count] <path>... -- <command>\n");
+        record_builtin_status(EXIT_FAILURE);
+        return;
+    }
+    if (strlen(command) >= MAX_INPUT) {
+        fprintf(stderr, "onchange: command is too long\n");
+        record_builtin_status(EXIT_FAILURE);
+        return;
+    }
+    char line[MAX_INPUT];
+    strcpy(line, command);
+
+    WatchSet set = {inotify_init1(IN_NONBLOCK | IN_CLOEXEC), NULL, 0, 0};
+    if (set.fd < 0) {
+        perror("onchange: inotify_init1");
+        record_builtin_status(EXIT_FAILURE);
+        return;
+    }
+    for (int j = i; j < arg_count; j++) {
+        if (watch_tree(&set, args[j]) < 0) {
+            close_watches(&set);
+            record_builtin_status(EXIT_FAILURE);
+            return;
+        }
+    }
+    bool keyboard = isatty(STDIN_FILENO);
+    fprintf(stderr, "onchange: watching %d paths%s\n", set.count, keyboard ? ", press q to stop" : "");
+
+    struct pollfd fds[3] = {
+        {set.fd, POLLIN, 0},
+        {job_queue_wake_fd(), POLLIN, 0},
+        {keyboard ? STDIN_FILENO : -1, POLLIN, 0}};
+    struct timespec started_at;
+    clock_gettime(CLOCK_MONOTONIC, &started_at);
+    pid_t running = start_run(line);
+    bool pending = false, queued = false;
+    double first_change = 0, last_change = 0;
+
+    while (runs_left != 0) {
+        // a burst of events is waited out, but never for longer than a few debounce periods
+        int timeout = -1;
+        if (pending) {
+            double now = monotonic_ms();
+            double quiet = last_change + debounce - now;
+            double latest = first_change + debounce * ONCHANGE_MAX_DELAY_FACTOR - now;
+            double wait = quiet < latest ? quiet : latest;
+            timeout = wait > 0 ? (int)wait + 1 : 0;
+        }
+        int ready = poll(fds, 3, timeout);
+        if (ready < 0 && errno != EINTR)
+            break;
+
+        if (ready > 0 && (fds[0].revents & POLLIN)) {
+            int changes = read_events(&set);
+            if (changes > 0) {
+                last_change = monotonic_ms();
+                if (!pending)
+                    first_change = last_change;
+                pending = true;
+            }
+        }
+        if (ready > 0 && (fds[1].revents & POLLIN)) {
+            reap_jobs();
+            reap_tasks();
+            if (running > 0 && wait_command(running, WNOHANG, "onchange", &started_at, NULL) == running) {
+                report_run(line, &started_at);
+                running = -1;
+                if (runs_left > 0)
+                    runs_left--;
+            }
+        }
+        if (ready > 0 && (fds[2].revents & POLLIN)) {
+            char c;
+            if (read(STDIN_FILENO, &c, 1) != 1 || c == 'q' || c == 'Q')
+                break;
+        }
+
+        double now = monotonic_ms();
+        if (pending && (now >= last_change + debounce || now >= first_change + debounce * ONCHANGE_MAX_DELAY_FACTOR)) {
+            pending = false;
+            if (running > 0 && mode == ONCHANGE_RESTART) {
+                stop_run(running, &started_at);
+                fprintf(stderr, "onchange: change detected, restarting '%s'\n", line);
+                running = -1;
+            }
+            // runs are never stacked, any number of changes during a run cause one more run after it
+            queued = true;
+        }
+        if (running < 0 && queued && runs_left != 0) {
+            queued = false;
+            clock_gettime(CLOCK_MONOTONIC, &started_at);
+            running = start_run(line);
+        }
+    }
+
+    if (running > 0)
+        stop_run(running, &started_at);
+    close_watches(&set);
+}
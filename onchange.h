@@ -0,0 +1,43 @@
+#ifndef ONCHANGE_H
+#define ONCHANGE_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define ONCHANGE_DEBOUNCE_MS 50
+#define ONCHANGE_MAX_DELAY_FACTOR 10
+#define ONCHANGE_KILL_GRACE_MS 1000
+#define ONCHANGE_EVENT_BUFFER 65536
+#define ONCHANGE_MASK (IN_CLOSE_WRITE | IN_MODIFY | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF)
+
+// watched paths indexed by inotify watch descriptor
+typedef struct {
+    int fd;
+    char **paths;
+    int capacity;
+    int count;
+} WatchSet;
+
+typedef enum {
+    ONCHANGE_QUEUE,
+    ONCHANGE_RESTART
+} onchange_mode;
+
+void handle_onchange(char **args, int arg_count);
+void run_onchange(char **args, int arg_count, const char *command);
+
+#endif
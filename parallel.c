@@ -0,0 +1,241 @@
+#include "parallel.h"
+#include "command_stats.h"
+
+static double elapsed_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// replace every {} in arg with input, the result is always heap allocated
+static char *substitute_placeholder(const char *arg, const char *input) {
+    size_t count = 0;
+    for (const char *p = strstr(arg, PARALLEL_PLACEHOLDER); p; p = strstr(p + 2, PARALLEL_PLACEHOLDER))
+        count++;
+
+    size_t input_len = strlen(input);
+    char *result = malloc(strlen(arg) + count * input_len + 1);
+    if (!result) {
+        perror("Memory error");
+        exit(EXIT_FAILURE);
+    }
+    char *out = result;
+    while (*arg) {
+        if (strncmp(arg, PARALLEL_PLACEHOLDER, 2) == 0) {
+            memcpy(out, input, input_len);
+            out += input_len;
+            arg += 2;
+        } else {
+            *out++ = *arg++;
+        }
+    }
+    *out = '\0';
+    return result;
+}
+
+static bool start_slot(ParallelSlot *slot, char **template, int template_count, bool has_placeholder,
+                       const char *input, int input_index, int null_fd) {
+    char *argv[MAX_ARGUMENTS + 1];
+    int argc = 0;
+    for (int i = 0; i < template_count && argc < MAX_ARGUMENTS - 1; i++)
+        argv[argc++] = substitute_placeholder(template[i], input);
+    if (!has_placeholder)
+        argv[argc++] = strdup(input);
+    argv[argc] = NULL;
+
+    int pipefd[2];
+    bool started = false;
+    if (pipe2(pipefd, O_CLOEXEC) == -1) {
+        perror("Failed to create pipe");
+    } else {
+        slot->pid = launch_command(argv, null_fd, pipefd[1], pipefd[1]);
+        close(pipefd[1]);
+        if (slot->pid > 0) {
+            slot->output_fd = pipefd[0];
+            slot->input_index = input_index;
+            slot->output_len = 0;
+            clock_gettime(CLOCK_MONOTONIC, &slot->started_at);
+            started = true;
+        } else {
+            close(pipefd[0]);
+        }
+    }
+
+    for (int i = 0; i < argc; i++)
+        free(argv[i]);
+    return started;
+}
+
+static void append_output(ParallelSlot *slot, const char *data, size_t len) {
+    if (slot->output_len + len > slot->output_cap) {
+        size_t cap = slot->output_cap ? slot->output_cap : 4096;
+        while (cap < slot->output_len + len)
+            cap *= 2;
+        char *grown = realloc(slot->output, cap);
+        if (!grown) {
+            perror("Memory error");
+            exit(EXIT_FAILURE);
+        }
+        slot->output = grown;
+        slot->output_cap = cap;
+    }
+    memcpy(slot->output + slot->output_len, data, len);
+    slot->output_len += len;
+}
+
+// child closed its output: reap it, then write its whole output in one go
+static int finish_slot(ParallelSlot *slot, const char *name, char **inputs, int input_count) {
+    CommandUsage usage = {0};
+    close(slot->output_fd);
+    wait_command(slot->pid, 0, name, &slot->started_at, &usage);
+
+    size_t written = 0;
+    while (written < slot->output_len) {
+        ssize_t n = write(STDOUT_FILENO, slot->output + written, slot->output_len - written);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        written += n;
+    }
+
+    fprintf(stderr, "[%d/%d] %s exit %d in %.3fs\n", slot->input_index + 1, input_count,
+            inputs[slot->input_index], usage.exit_status, usage.wall_time);
+    slot->pid = 0;
+    return usage.exit_status;
+}
+
+static int read_stdin_inputs(char ***inputs) {
+    int count = 0, cap = 64;
+    char *line = NULL;
+    size_t line_cap = 0;
+    ssize_t len;
+
+    *inputs = malloc(cap * sizeof(char *));
+    while ((len = getline(&line, &line_cap, stdin)) != -1) {
+        if (len > 0 && line[len - 1] == '\n')
+            line[len - 1] = '\0';
+        if (count == cap) {
+            cap *= 2;
+            *inputs = realloc(*inputs, cap * sizeof(char *));
+        }
+        (*inputs)[count++] = strdup(line);
+    }
+    free(line);
+    clearerr(stdin);
+    return count;
+}
+
+void handle_parallel(char **args, int arg_count) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int slots_wanted = cpus > 0 ? (int)cpus : 1;
+    int i = 1;
+
+    if (i + 1 < arg_count && strcmp(args[i], "-j") == 0) {
+        slots_wanted = atoi(args[i + 1]);
+        i += 2;
+    }
+    if (slots_wanted < 1)
+        slots_wanted = 1;
+    if (slots_wanted > PARALLEL_MAX_SLOTS)
+        slots_wanted = PARALLEL_MAX_SLOTS;
+
+    char **template = &args[i];
+    int template_count = 0;
+    bool has_placeholder = false;
+    while (i < arg_count && strcmp(args[i], PARALLEL_SEPARATOR) != 0) {
+        if (strstr(args[i], PARALLEL_PLACEHOLDER))
+            has_placeholder = true;
+        template_count++;
+        i++;
+    }
+    if (template_count == 0) {
+        fprintf(stderr, "Usage: parallel [-j N] command [{}] ::: args... (or one arg per line on stdin)\n");
+        record_builtin_status(EXIT_FAILURE);
+        return;
+    }
+
+    char **inputs;
+    int input_count;
+    bool owns_inputs = false;
+    if (i < arg_count) {
+        inputs = &args[i + 1];
+        input_count = arg_count - i - 1;
+    } else {
+        input_count = read_stdin_inputs(&inputs);
+        owns_inputs = true;
+    }
+
+    int null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    ParallelSlot slots[PARALLEL_MAX_SLOTS];
+    struct pollfd fds[PARALLEL_MAX_SLOTS];
+    int slot_of_fd[PARALLEL_MAX_SLOTS];
+    memset(slots, 0, sizeof(slots));
+
+    struct timespec started_at;
+    clock_gettime(CLOCK_MONOTONIC, &started_at);
+    int next_input = 0, active = 0, failed = 0;
+    char buffer[65536];
+    fflush(stdout);
+
+    while (next_input < input_count || active > 0) {
+        // keep every slot busy while there is input left
+        for (int s = 0; s < slots_wanted && next_input < input_count; s++) {
+            if (slots[s].pid != 0)
+                continue;
+            int index = next_input++;
+            if (start_slot(&slots[s], template, template_count, has_placeholder, inputs[index], index, null_fd))
+                active++;
+            else
+                failed++;
+        }
+        if (active == 0)
+            continue;
+
+        int nfds = 0;
+        for (int s = 0; s < slots_wanted; s++) {
+            if (slots[s].pid == 0)
+                continue;
+            fds[nfds].fd = slots[s].output_fd;
+            fds[nfds].events = POLLIN;
+            slot_of_fd[nfds++] = s;
+        }
+        if (poll(fds, nfds, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            break;
+        }
+
+        for (int f = 0; f < nfds; f++) {
+            if (!(fds[f].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+            ParallelSlot *slot = &slots[slot_of_fd[f]];
+            ssize_t n = read(slot->output_fd, buffer, sizeof(buffer));
+            if (n > 0) {
+                append_output(slot, buffer, n);
+            } else if (n == 0 || errno != EINTR) {
+                if (finish_slot(slot, template[0], inputs, input_count) != 0)
+                    failed++;
+                active--;
+            }
+        }
+    }
+
+    double total = elapsed_since(&started_at);
+    fprintf(stderr, "%d jobs, %d failed, %d slots, %.3fs (%.1f tasks/s)\n", input_count, failed,
+            slots_wanted, total, total > 0 ? input_count / total : 0.0);
+    // the per-job waits left $? at whichever job finished last
+    record_builtin_status(failed ? EXIT_FAILURE : 0);
+
+    for (int s = 0; s < PARALLEL_MAX_SLOTS; s++)
+        free(slots[s].output);
+    if (null_fd >= 0)
+        close(null_fd);
+    if (owns_inputs) {
+        for (int k = 0; k < input_count; k++)
+            free(inputs[k]);
+        free(inputs);
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "shell.h"
+
+#define PARALLEL_MAX_SLOTS 256
+#define PARALLEL_SEPARATOR ":::"
+#define PARALLEL_PLACEHOLDER "{}"
+
+typedef struct {
+    pid_t pid;
+    int input_index;
+    int output_fd;
+    char *output;
+    size_t output_len;
+    size_t output_cap;
+    struct timespec started_at;
+} ParallelSlot;
+
+void handle_parallel(char **args, int arg_count);
+
+#endif
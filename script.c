@@ -0,0 +1,132 @@
+#include "script.h"
+#include "job_queue.h"
+#include "command_stats.h"
+#include "task_scheduler.h"
+
+unsigned long lines_executed = 0;
+
+// exec_command tokenizes in place, so each line gets its own copy
+static void run_line(const char *line, size_t length) {
+    char input[MAX_INPUT];
+
+    if (length > 0 && line[length - 1] == '\r')
+        length--;
+    while (length > 0 && (*line == ' ' || *line == '\t')) {
+        line++;
+        length--;
+    }
+    if (length == 0 || *line == '#')
+        return;
+    if (length >= MAX_INPUT) {
+        fprintf(stderr, "Line too long, at most %d characters are supported.\n", MAX_INPUT - 1);
+        record_builtin_status(EXIT_FAILURE);
+        return;
+    }
+
+    memcpy(input, line, length);
+    input[length] = '\0';
+    exec_command(input);
+    lines_executed++;
+    if (job_count > 0)
+        reap_jobs();
+    task_scheduler();
+    reap_tasks();
+}
+
+// run every complete line in text, returns how many bytes were consumed
+static size_t run_lines(const char *text, size_t length, bool final) {
+    size_t consumed = 0;
+    while (consumed < length) {
+        const char *end = memchr(text + consumed, '\n', length - consumed);
+        if (!end) {
+            if (!final)
+                break;
+            run_line(text + consumed, length - consumed);
+            return length;
+        }
+        run_line(text + consumed, end - (text + consumed));
+        consumed = end - text + 1;
+    }
+    return consumed;
+}
+
+int run_script_string(const char *text, size_t length) {
+    run_lines(text, length, true);
+    return last_exit_status();
+}
+
+int run_script_file(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        perror(path);
+        return 127;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        // not something we can map, fall back to reading it
+        int status = run_script_fd(fd);
+        close(fd);
+        return status;
+    }
+
+    char *text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (text == MAP_FAILED) {
+        perror("Failed to map script");
+        return EXIT_FAILURE;
+    }
+    madvise(text, st.st_size, MADV_SEQUENTIAL);
+    int status = run_script_string(text, st.st_size);
+    munmap(text, st.st_size);
+    return status;
+}
+
+int run_script_fd(int fd) {
+    char *buffer = malloc(SCRIPT_READ_SIZE + MAX_INPUT);
+    size_t filled = 0;
+    bool skipping = false;
+    if (!buffer) {
+        perror("Memory error");
+        return EXIT_FAILURE;
+    }
+
+    while (1) {
+        ssize_t n = read(fd, buffer + filled, SCRIPT_READ_SIZE + MAX_INPUT - filled);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("Failed to read script");
+            break;
+        }
+        filled += n;
+
+        size_t start = 0;
+        if (skipping) {
+            char *end = memchr(buffer, '\n', filled);
+            if (end) {
+                start = end - buffer + 1;
+                skipping = false;
+            } else {
+                start = filled;
+            }
+        }
+        size_t consumed = start + run_lines(buffer + start, filled - start, n == 0);
+        memmove(buffer, buffer + consumed, filled - consumed);
+        filled -= consumed;
+        if (n == 0)
+            break;
+        if (filled == SCRIPT_READ_SIZE + MAX_INPUT) {
+            // a single line filled the whole buffer, drop it up to its newline
+            fprintf(stderr, "Line too long, at most %d characters are supported.\n", MAX_INPUT - 1);
+            record_builtin_status(EXIT_FAILURE);
+            skipping = true;
+            filled = 0;
+        }
+    }
+    free(buffer);
+    return last_exit_status();
+}
+
+unsigned long script_lines_executed() {
+    return lines_executed;
+}
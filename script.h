@@ -0,0 +1,26 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "shell.h"
+
+#define SCRIPT_READ_SIZE 65536
+
+int run_script_string(const char *text, size_t length);
+int run_script_file(const char *path);
+int run_script_fd(int fd);
+unsigned long script_lines_executed();
+
+#endif
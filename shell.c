@@ -2,6 +2,19 @@
 #include "task_scheduler.c"
 #include "focus_mode.c"
 #include "auto_delete.h"
+#include "job_queue.h"
+#include "parallel.h"
+#include "command_stats.h"
+#include "trace.h"
+#include "script.h"
+#include "copy_engine.h"
+#include "sysmon.h"
+#include "command_cache.h"
+#include "glob_expand.h"
+#include "variables.h"
+#include "onchange.h"
+#include "completion_specs.h"
+#include <poll.h>
 
 Node *current = NULL;
 Node *history_head;
@@ -9,83 +22,13 @@ TrieNode *autocomplete_head = NULL;
 struct termios orig_termios;
 struct sysinfo memInfo;
 struct utsname unameData;
-Job jobs[MAX_JOBS];
-int job_count = 0;
+bool interactive = true;
 char *common_commands[] = {
     "cd", "pwd", "ls", "exit", "clear", "echo", "help", "uname", "top", "whoami", "whatisthis",
-    "kill", "service", "gcc", "bg", "fg", "schedule", "focusmode",
-    NULL};
-/*
-typedef struct {
-    pid_t pid;
-    int job_id;
-    job_status status;
-    int priority;
-    char command[COMMAND_SIZE];
-} Job;
-
-*/
-void add_job(pid_t pid, char **command, int priority)
-{
-    // jobs[job_count].command = strdup(command[0]);
-    jobs[job_count].priority = priority;
-    jobs[job_count].pid = pid;
-    jobs[job_count].job_id = job_count + 1;
-    jobs[job_count].status = RUNNING;
-    job_count++;
-}
-void list_jobs()
-{
-    for (int i = 0; i < job_count; i++)
-    {
-        printf("[%d] %s (%d) %s\n", jobs[i].job_id, jobs[i].command, jobs[i].pid, jobs[i].status == RUNNING ? GRN "Running" RESET : RED "Stopped" RESET);
-    }
-}
-void suspend_job(int job_id)
-{
-    pid_t pid = jobs[job_id - 1].pid;
-
-    if (kill(pid, SIGTSTP) == -1)
-    {
-        perror("Failed to suspend job.");
-        return;
-    }
-    jobs[job_id - 1].status = STOPPED;
-    printf("Job %d (%s) suspended\n", job_id, jobs[job_id - 1].command);
-}
-void kill_job(int job_id)
-{
-    pid_t pid = jobs[job_id - 1].pid;
-
-    if (kill(pid, SIGKILL) == -1)
-    {
-        perror("Failed to kill the job.");
-        return;
-    }
-    jobs[job_id - 1].status = TERMINATED;
-    printf("Job %d (%s) kill\n", job_id, jobs[job_id - 1].command);
-}
-void run_job_background(char **command, int priority)
-{
-    pid_t pid = fork();
-    if (pid < 0)
-    {
-        perror("Failed to fork.");
-        exit(EXIT_FAILURE);
-    }
-    else if (pid > 0)
-    {
-        // let the parent process take place too
-        return;
-    }
-    else
-    {
-        add_job(pid, command, priority);
-        execvp(command[0], command);
-        perror("Failed to execute command");
-        exit(EXIT_FAILURE);
-    }
-}
+    "kill", "service", "gcc", "bg", "fg", "jobs", "parallel", "schedule", "stats", "time", "trace", "cp", "cat", "focusmode",
+    "cached", "export", "unset", "onchange", NULL};
+// builtins that only cover the option-less form and leave anything else to the real binary
+char *plain_builtin_commands[] = {"cp", "cat", NULL};
 
 TrieNode *createNode()
 {
@@ -140,11 +83,21 @@ void collect_words(TrieNode *node, char *prefix, int length)
     }
 }
 
+// the command trie is only built the first time Tab is pressed
+void seed_trie()
+{
+    if (autocomplete_head)
+        return;
+    for (int i = 0; common_commands[i] != NULL; i++)
+    {
+        insert_into_trie(common_commands[i]);
+    }
+}
+
 void search_prefix(char *prefix)
 {
+    seed_trie();
     char *temp_string = strdup(prefix);
-    if (!autocomplete_head)
-        return;
     TrieNode *temp = autocomplete_head;
     int prefix_length = 0;
     while (*prefix)
@@ -242,44 +195,126 @@ void change_directory(char **args)
     return;
 }
 
+// Fork and exec args with in_fd/out_fd/err_fd as its standard streams (-1 keeps the shell's own)
+pid_t launch_command(char **args, int in_fd, int out_fd, int err_fd)
+{
+    char **envp = variable_envp();
+    fflush(stdout);
+    TRACE_BEGIN(spawn_start);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("Failed to fork");
+        return -1;
+    }
+    if (pid == 0)
+    {
+        if (in_fd >= 0 && in_fd != STDIN_FILENO)
+            dup2(in_fd, STDIN_FILENO);
+        if (out_fd >= 0 && out_fd != STDOUT_FILENO)
+            dup2(out_fd, STDOUT_FILENO);
+        if (err_fd >= 0 && err_fd != STDERR_FILENO)
+            dup2(err_fd, STDERR_FILENO);
+        signal(SIGPIPE, SIG_DFL);
+        execvpe(args[0], args, envp);
+        perror("Failed to execute command");
+        _exit(EXIT_FAILURE);
+    }
+    TRACE_END(TRACE_SPAWN, spawn_start);
+    return pid;
+}
+
+bool is_builtin(char **args)
+{
+    for (int i = 0; plain_builtin_commands[i] != NULL; i++)
+    {
+        if (strcmp(plain_builtin_commands[i], args[0]) != 0)
+            continue;
+        for (int j = 1; args[j] != NULL; j++)
+        {
+            if (args[j][0] == '-' && args[j][1] != '\0')
+                return false;
+        }
+    }
+    return find_builtin(args[0]) != NULL;
+}
+
+int count_args(char **args)
+{
+    int count = 0;
+    while (args[count] != NULL)
+        count++;
+    return count;
+}
+
+// Run a builtin inside the shell with stdin/stdout pointed at in_fd/out_fd (-1 keeps the shell's own)
+void run_builtin_with_fds(char **args, int in_fd, int out_fd)
+{
+    int saved_in = -1, saved_out = -1;
+    struct sigaction ignore_pipe, saved_pipe;
+
+    // a reader that exits early must not take the shell down with SIGPIPE
+    memset(&ignore_pipe, 0, sizeof(ignore_pipe));
+    ignore_pipe.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ignore_pipe, &saved_pipe);
+
+    fflush(stdout);
+    if (out_fd >= 0)
+    {
+        saved_out = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 3);
+        dup2(out_fd, STDOUT_FILENO);
+    }
+    if (in_fd >= 0)
+    {
+        saved_in = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 3);
+        dup2(in_fd, STDIN_FILENO);
+        clearerr(stdin);
+    }
+
+    record_builtin_status(0);
+    run_builtin(args, count_args(args));
+    fflush(stdout);
+    clearerr(stdout);
+
+    if (saved_out >= 0)
+    {
+        dup2(saved_out, STDOUT_FILENO);
+        close(saved_out);
+    }
+    if (saved_in >= 0)
+    {
+        dup2(saved_in, STDIN_FILENO);
+        close(saved_in);
+        clearerr(stdin);
+    }
+    sigaction(SIGPIPE, &saved_pipe, NULL);
+}
+
 void handle_redirection(char **args, char *file)
 {
-    int fd = 0;
     if (file)
     {
-        fd = open(file, O_WRONLY | O_CREAT);
+        TRACE_BEGIN(redirect_start);
+        int fd = open(file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        TRACE_END(TRACE_REDIRECT, redirect_start);
         if (fd < 0)
         {
             perror("Failed to open file for redirection");
             return;
         }
-        else
+        if (is_builtin(args))
         {
-            int saved_stdout = dup(STDOUT_FILENO);
-            dup2(fd, STDOUT_FILENO);
+            run_builtin_with_fds(args, -1, fd);
             close(fd);
-
-            // run the process
-            pid_t pid = fork();
-            if (pid < 0)
-            {
-                perror("Failed to fork.");
-                exit(EXIT_FAILURE);
-            }
-            else if (pid == 0)
-            {
-                execvp(args[0], args);
-                perror("Failed to execute command");
-                exit(EXIT_FAILURE);
-            }
-            else
-            {
-                wait(NULL);
-            }
-
-            // restore stdout
-            dup2(saved_stdout, STDOUT_FILENO);
-            close(saved_stdout);
+            return;
+        }
+        struct timespec started_at;
+        clock_gettime(CLOCK_MONOTONIC, &started_at);
+        pid_t pid = launch_command(args, -1, fd, -1);
+        close(fd);
+        if (pid > 0)
+        {
+            wait_command(pid, 0, args[0], &started_at, NULL);
         }
     }
     else
@@ -289,56 +324,118 @@ void handle_redirection(char **args, char *file)
     }
 }
 
+// Like launch_command for a builtin stage, only used when both pipeline stages are builtins.
+// There is no exec to drop close-on-exec fds, so the pipe's read end is closed by hand.
+pid_t launch_builtin(char **args, int out_fd, int read_fd)
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("Failed to fork");
+        return -1;
+    }
+    if (pid == 0)
+    {
+        dup2(out_fd, STDOUT_FILENO);
+        close(out_fd);
+        close(read_fd);
+        signal(SIGPIPE, SIG_DFL);
+        record_builtin_status(0);
+        run_builtin(args, count_args(args));
+        fflush(stdout);
+        _exit(last_exit_status());
+    }
+    return pid;
+}
+
 void handle_pipeline(char **command1, char **command2)
 {
     int pipefd[2];
-    pid_t pid1, pid2;
+    pid_t pid1 = -1, pid2 = -1;
+    int builtin2_status = -1;
+    if (command1[0] == NULL || command2[0] == NULL)
+    {
+        fprintf(stderr, "Syntax error: empty command in pipeline.\n");
+        record_builtin_status(EXIT_FAILURE);
+        return;
+    }
+    bool builtin1 = is_builtin(command1);
+    bool builtin2 = is_builtin(command2);
 
-    if (pipe(pipefd) == -1)
+    // close-on-exec so neither child holds the other end open
+    if (pipe2(pipefd, O_CLOEXEC) == -1)
     {
         perror("Failed to create pipe");
-        exit(EXIT_FAILURE);
+        return;
     }
     // pipefd[0] is the read end and the pipefd[1] is the write end
 
-    pid1 = fork();
-    if (pid1 == 0)
+    struct timespec started_at;
+    clock_gettime(CLOCK_MONOTONIC, &started_at);
+    if (builtin1 && !builtin2)
     {
-
-        dup2(pipefd[1], STDOUT_FILENO);
+        // the reader has to be running before the builtin fills the pipe
+        pid2 = launch_command(command2, pipefd[0], -1, -1);
         close(pipefd[0]);
-        execvp(command1[0], command1);
-        perror("Failed to execute command");
-        exit(EXIT_FAILURE);
+        run_builtin_with_fds(command1, -1, pipefd[1]);
+        close(pipefd[1]);
     }
-
-    pid2 = fork();
-    if (pid2 == 0)
+    else if (builtin2 && !builtin1)
     {
-
-        dup2(pipefd[0], STDIN_FILENO);
+        pid1 = launch_command(command1, -1, pipefd[1], -1);
         close(pipefd[1]);
-        execvp(command2[0], command2);
-        perror("Failed to execute command");
-        exit(EXIT_FAILURE);
+        run_builtin_with_fds(command2, pipefd[0], -1);
+        builtin2_status = last_exit_status();
+        close(pipefd[0]);
+    }
+    else
+    {
+        pid1 = builtin1 ? launch_builtin(command1, pipefd[1], pipefd[0]) : launch_command(command1, -1, pipefd[1], -1);
+        close(pipefd[1]);
+        if (builtin2)
+        {
+            run_builtin_with_fds(command2, pipefd[0], -1);
+            builtin2_status = last_exit_status();
+        }
+        else
+        {
+            pid2 = launch_command(command2, pipefd[0], -1, -1);
+        }
+        close(pipefd[0]);
     }
 
-    close(pipefd[0]);
-    close(pipefd[1]);
-
-    wait(NULL);
-    wait(NULL);
+    // each stage is accounted separately, the last one wait for sets $?
+    if (pid1 > 0)
+        wait_command(pid1, 0, command1[0], &started_at, NULL);
+    if (pid2 > 0)
+        wait_command(pid2, 0, command2[0], &started_at, NULL);
+    if (builtin2_status >= 0)
+        record_builtin_status(builtin2_status);
 }
 
-void handle_jobs(char **args, int arg_count)
+void handle_jobs(char **args, int arg_count, int priority)
 {
-    if (args[1] == NULL)
+    if (arg_count == 0)
     {
         fprintf(stderr, "Failed to run background jobs: Require more arguements.\n");
         return;
     }
-    int priority = atoi(args[arg_count - 1]);
-    pid_t pid = fork();
+    char command[MAX_INPUT] = {0};
+    for (int i = 0; i < arg_count; i++)
+    {
+        if (strlen(command) + strlen(args[i]) + 1 >= MAX_INPUT)
+        {
+            fprintf(stderr, "Failed to run background jobs: Command is too long.\n");
+            return;
+        }
+        strcat(command, args[i]);
+        if (i < arg_count - 1)
+        {
+            strcat(command, " ");
+        }
+    }
+    submit_job(command, priority);
 }
 
 void handle_cleanup(char** args, int arg_count) {
@@ -366,6 +463,10 @@ void handle_cleanup(char** args, int arg_count) {
     }
 }
 void handle_task_scheduler(char **arguments, int arg_count) {
+    if (arg_count == 2 && strcmp(arguments[1], "list") == 0) {
+        print_tasks();
+        return;
+    }
     if (arg_count < 3) {
         fprintf(stderr, "Failed to run task scheduler command: Requires more arguments.\n");
         return;
@@ -404,23 +505,236 @@ void handle_task_scheduler(char **arguments, int arg_count) {
 }
 
 void handle_focus_mode(char **args, int arg_count) {
-    if(arg_count < 1) {
-        fprintf(stderr, "Not enough arguements, specify 'enable' or 'disable'\n");
+    if(arg_count < 2) {
+        fprintf(stderr, "Not enough arguements, specify 'enable', 'disable' or 'status'\n");
+        record_builtin_status(EXIT_FAILURE);
         return;
     }
     
     if(strcmp(args[1], "enable") == 0) {
-        enable_focus_mode();
+        enable_focus_mode(args + 2, arg_count - 2);
     } else if(strcmp(args[1], "disable") == 0) {
-        disable_focus_mode();
+        disable_focus_mode(args + 2, arg_count - 2);
+    } else if(strcmp(args[1], "status") == 0) {
+        focus_mode_status();
     } else {
-        fprintf(stderr, "Invalid arguement, specify 'enable' or 'disable'\n");
+        fprintf(stderr, "Invalid arguement, specify 'enable', 'disable' or 'status'\n");
+        record_builtin_status(EXIT_FAILURE);
+        return;
+    }
+}
+
+void builtin_whatisthis(char **args, int arg_count)
+{
+    printf("This is a custom shell developed in C due to the fact that the developer was bored.\n");
+}
+
+void builtin_help(char **args, int arg_count)
+{
+    printf("Refer to https://github.com/SreehariSanjeev04/custom_shell for the commands. Use 'man' for more information regarding a command. \n");
+}
+
+void builtin_exit(char **args, int arg_count)
+{
+    int status = args[1] ? atoi(args[1]) : last_exit_status();
+    if (interactive)
+    {
+        printf("Exiting shell.\n");
+    }
+    else
+    {
+        // a script that exits early still lets its queued jobs and tasks finish
+        wait_for_background_work();
+    }
+    exit(status);
+}
+
+void builtin_sysusage(char **args, int arg_count)
+{
+    if (args[1] && strcmp(args[1], "--watch") == 0)
+    {
+        sysusage_watch(args, arg_count);
+        return;
+    }
+    sysusage();
+}
+
+void builtin_cd(char **args, int arg_count)
+{
+    change_directory(args);
+}
+
+void builtin_jobs(char **args, int arg_count)
+{
+    if (arg_count == 3 && strcmp(args[1], "-j") == 0)
+    {
+        set_max_running(atoi(args[2]));
         return;
     }
+    if (arg_count == 3 && strcmp(args[1], "-k") == 0)
+    {
+        kill_job(atoi(args[2]));
+        return;
+    }
+    list_jobs();
+}
+
+void builtin_stats(char **args, int arg_count)
+{
+    print_command_stats(args[1]);
 }
 
-// Execute shell commands
+// the one list of builtins, is_builtin() and run_builtin() both look names up here
+Builtin builtins[] = {
+    {"whatisthis", builtin_whatisthis},
+    {"help", builtin_help},
+    {"exit", builtin_exit},
+    {"sysusage", builtin_sysusage},
+    {"cd", builtin_cd},
+    {"jobs", builtin_jobs},
+    {"parallel", handle_parallel},
+    {"cp", handle_cp},
+    {"cat", handle_cat},
+    {"export", handle_export},
+    {"unset", handle_unset},
+    {"onchange", handle_onchange},
+    {"cached", handle_cached},
+    {"trace", handle_trace},
+    {"stats", builtin_stats},
+    {"schedule", handle_task_scheduler},
+    {"focusmode", handle_focus_mode},
+    {NULL, NULL}};
+
+Builtin *find_builtin(const char *name)
+{
+    for (int i = 0; builtins[i].name != NULL; i++)
+    {
+        if (strcmp(builtins[i].name, name) == 0)
+            return &builtins[i];
+    }
+    return NULL;
+}
+
+// Run args as a builtin, returns false when it is not one
+bool run_builtin(char **args, int arg_count)
+{
+    Builtin *builtin = find_builtin(args[0]);
+    if (!builtin)
+        return false;
+    builtin->handler(args, arg_count);
+    return true;
+}
+
+// Run a command line and report its wall time and the CPU time and peak RSS of its children
+void handle_time(char *input)
+{
+    struct timespec started_at, finished_at;
+    clock_gettime(CLOCK_MONOTONIC, &started_at);
+    begin_usage_window();
+    exec_command(input);
+    clock_gettime(CLOCK_MONOTONIC, &finished_at);
+
+    CommandUsage total = usage_window_total();
+    double real = (finished_at.tv_sec - started_at.tv_sec) + (finished_at.tv_nsec - started_at.tv_nsec) / 1e9;
+    fprintf(stderr, "\nreal\t%.3fs\nuser\t%.3fs\nsys\t%.3fs\nmaxrss\t%ld KB\n", real, total.user_time, total.sys_time, total.max_rss_kb);
+}
+
+// Like strtok(" "), but $(...) and `...` stay in one word even when they contain spaces
+char *next_word(char **cursor)
+{
+    char *p = *cursor;
+    while (*p == ' ')
+        p++;
+    if (*p == '\0')
+    {
+        *cursor = p;
+        return NULL;
+    }
+    char *word = p;
+    int depth = 0;
+    bool backtick = false;
+    for (; *p; p++)
+    {
+        if (backtick)
+            backtick = *p != '`';
+        else if (*p == '`')
+            backtick = true;
+        else if (*p == '(' && (depth > 0 || (p > word && p[-1] == '$')))
+            depth++;
+        else if (*p == ')' && depth > 0)
+            depth--;
+        else if (*p == ' ' && depth == 0)
+            break;
+    }
+    if (*p)
+        *p++ = '\0';
+    *cursor = p;
+    return word;
+}
+
+// Expand variables, substitutions, braces and wildcards in token into words[count..limit), returns the new count or -1 when it does not fit
+int expand_word(GlobExpansion *globs, char *token, char **words, int count, int limit)
+{
+    char *expanded_token = expand_variables(token);
+    if (expanded_token)
+        glob_keep_string(globs, expanded_token);
+    if (is_assignment(token))
+    {
+        // assignment values are taken as they are, without splitting or wildcard expansion
+        if (count == limit)
+            return -1;
+        words[count] = expanded_token ? expanded_token : token;
+        return count + 1;
+    }
+    if (!expanded_token)
+    {
+        int expanded = glob_expand(globs, token, words + count, limit - count);
+        return expanded < 0 ? -1 : count + expanded;
+    }
+    // like unquoted expansions in sh the result is split into words, and one that expands to nothing is no word at all
+    char *save;
+    for (char *field = strtok_r(expanded_token, " \t\n", &save); field; field = strtok_r(NULL, " \t\n", &save))
+    {
+        int expanded = glob_expand(globs, field, words + count, limit - count);
+        if (expanded < 0)
+            return -1;
+        count += expanded;
+    }
+    return count;
+}
+
+// Execute shell commands, directories read while expanding wildcards are shared by the whole line
 void exec_command(char *input)
+{
+    GlobExpansion globs;
+    glob_begin(&globs);
+    run_command_line(input, &globs);
+    glob_end(&globs);
+}
+
+// onchange keeps the command after '--' as typed, so pipes, $VAR, $(...) and wildcards are handled again on every run
+void run_onchange_line(char *input, GlobExpansion *globs)
+{
+    char *args[MAX_ARGUMENTS];
+    int arg_count = 0;
+    char *cursor = input;
+    char *token;
+    while ((token = next_word(&cursor)) != NULL && strcmp(token, "--") != 0)
+    {
+        arg_count = expand_word(globs, token, args, arg_count, MAX_ARGUMENTS - 1);
+        if (arg_count < 0)
+        {
+            fprintf(stderr, "Too many arguments, at most %d are supported.\n", MAX_ARGUMENTS - 1);
+            record_builtin_status(EXIT_FAILURE);
+            return;
+        }
+    }
+    args[arg_count] = NULL;
+    record_builtin_status(0);
+    run_onchange(args, arg_count, token ? cursor : NULL);
+}
+
+void run_command_line(char *input, GlobExpansion *globs)
 {
     bool redirection = false;
     bool pipeline = false;
@@ -430,24 +744,39 @@ void exec_command(char *input)
     char *command2[MAX_ARGUMENTS];
     int arg_count = 0;
     int command_two_idx = 0;
-    char *token = strtok(input, " ");
 
-    while (token != NULL)
+    while (*input == ' ')
+        input++;
+    if (strncmp(input, "time ", 5) == 0)
     {
-        // if(*token == '&') {
-        //     // Handle background jobs
-        //     args[arg_count] = NULL;
-        //     token = strtok(NULL, " ");
+        handle_time(input + 5);
+        return;
+    }
+    if (strncmp(input, "onchange ", 9) == 0)
+    {
+        run_onchange_line(input, globs);
+        return;
+    }
+    TRACE_BEGIN(parse_start);
+    char *cursor = input;
+    char *token = next_word(&cursor);
 
-        //     handle_jobs(args, arg_count);
-        //     break;
-        // }
+    while (token != NULL)
+    {
+        if (strcmp(token, "&") == 0)
+        {
+            // Handle background jobs, an optional priority may follow the '&'
+            args[arg_count] = NULL;
+            token = next_word(&cursor);
+            handle_jobs(args, arg_count, token ? atoi(token) : PRIORITY_DEFAULT);
+            return;
+        }
 
         if (*token == '|')
         {
             pipeline = true;
             command1[arg_count] = NULL;
-            token = strtok(NULL, " ");
+            token = next_word(&cursor);
             break;
         }
 
@@ -455,12 +784,23 @@ void exec_command(char *input)
         {
             // Handle redirection
             redirection = true;
-            file = strtok(NULL, " ");
+            token = next_word(&cursor);
+            if (token && expand_word(globs, token, &file, 0, 1) < 0)
+            {
+                fprintf(stderr, "%s: ambiguous redirect\n", token);
+                return;
+            }
             break;
         }
-        command1[arg_count] = token;
-        args[arg_count++] = token;
-        token = strtok(NULL, " ");
+        int expanded = expand_word(globs, token, args, arg_count, MAX_ARGUMENTS - 1);
+        if (expanded < 0)
+        {
+            fprintf(stderr, "Too many arguments, at most %d are supported.\n", MAX_ARGUMENTS - 1);
+            return;
+        }
+        for (; arg_count < expanded; arg_count++)
+            command1[arg_count] = args[arg_count];
+        token = next_word(&cursor);
     }
     args[arg_count] = NULL;
     if (pipeline)
@@ -468,84 +808,123 @@ void exec_command(char *input)
         int i = 0;
         while (token != NULL)
         {
-            command2[i++] = token;
-            token = strtok(NULL, " ");
+            i = expand_word(globs, token, command2, i, MAX_ARGUMENTS - 1);
+            if (i < 0)
+            {
+                fprintf(stderr, "Too many arguments, at most %d are supported.\n", MAX_ARGUMENTS - 1);
+                return;
+            }
+            token = next_word(&cursor);
         }
         command2[i] = NULL;
-        handle_pipeline(command1, command2);
-        return;
     }
-    // check for redirection
-    if (redirection)
+    TRACE_END(TRACE_PARSE, parse_start);
+    if (arg_count == 0 && !pipeline)
     {
-        handle_redirection(args, file);
-        redirection = false;
         return;
     }
-    if (strcmp(args[0], "whatisthis") == 0)
-    {
-        printf("This is a custom shell developed in C due to the fact that the developer was bored.\n");
-        return;
-    }
-    if (strcmp(args[0], "help") == 0)
-    {
-        printf("Refer to https://github.com/SreehariSanjeev04/custom_shell for the commands. Use 'man' for more information regarding a command. \n");
-        return;
-    }
-    if (strcmp(args[0], "exit") == 0)
-    {
-        printf("Exiting shell.\n");
-        exit(EXIT_SUCCESS);
-    }
-    if (strcmp(args[0], "sysusage") == 0)
+    if (pipeline)
     {
-        sysusage();
+        handle_pipeline(command1, command2);
         return;
     }
-    if (strcmp(args[0], "cd") == 0)
+    // check for redirection
+    if (redirection)
     {
-        change_directory(args);
+        handle_redirection(args, file);
+        redirection = false;
         return;
     }
-    if(strcmp(args[0], "schedule") == 0)
+    if (is_assignment(args[0]))
     {
-        handle_task_scheduler(args, arg_count);
-        return;
-    }
-    if(strcmp(args[0], "focusmode") == 0) {
-        handle_focus_mode(args, arg_count);
-        return;
+        // NAME=value on its own sets a shell variable, 'export' makes it part of the environment
+        int i = 0;
+        while (i < arg_count && is_assignment(args[i]))
+            i++;
+        if (i == arg_count)
+        {
+            for (i = 0; i < arg_count; i++)
+                assign_variable(args[i], false);
+            record_builtin_status(0);
+            return;
+        }
     }
-    pid_t pid = fork();
-    if (pid < 0)
+    if (is_builtin(args))
     {
-        perror("Failed to fork");
+        // builtins report failure through record_builtin_status
+        record_builtin_status(0);
+        run_builtin(args, arg_count);
         return;
     }
-    if (pid == 0)
+    struct timespec started_at;
+    clock_gettime(CLOCK_MONOTONIC, &started_at);
+    pid_t pid = launch_command(args, -1, -1, -1);
+    if (pid > 0)
     {
-        execvp(args[0], args);
-        perror("Failed to execute command");
-        exit(EXIT_FAILURE);
+        wait_command(pid, 0, args[0], &started_at, NULL);
     }
-    else
+}
+
+// Wait for a keystroke, finishing background jobs, starting queued ones and firing due tasks meanwhile
+int read_key()
+{
+    struct pollfd fds[2] = {
+        {STDIN_FILENO, POLLIN, 0},
+        {job_queue_wake_fd(), POLLIN, 0}};
+    unsigned char c;
+
+    fflush(stdout);
+    while (1)
     {
-        wait(NULL);
+        int ready = poll(fds, 2, next_task_timeout_ms());
+        if (ready == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            return EOF;
+        }
+        if (ready == 0)
+        {
+            task_scheduler();
+            continue;
+        }
+        if (fds[1].revents & POLLIN)
+        {
+            reap_jobs();
+            reap_tasks();
+        }
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR))
+        {
+            if (read(STDIN_FILENO, &c, 1) != 1)
+                return EOF;
+            return c;
+        }
     }
 }
 
 void readInput(char *buffer)
 {
     int index = 0;
-    char c;
+    int c;
     current = history_head;
     while (1)
     {
-        c = getchar();
+        c = read_key();
+        TRACE_BEGIN(key_start);
+        if (c == EOF)
+        {
+            if (index == 0)
+            {
+                printf("\n");
+                exit(EXIT_SUCCESS);
+            }
+            c = '\n';
+        }
         if (c == '\n')
         {
             buffer[index] = '\0';
             printf("\n");
+            TRACE_END(TRACE_KEYSTROKE, key_start);
             break;
         }
         else if (c == 127)
@@ -560,15 +939,19 @@ void readInput(char *buffer)
         {
             buffer[index] = '\0';
             printf("\nSuggestions: \n");
-            search_prefix(buffer);
+            TRACE_BEGIN(completion_start);
+            // past the command name, a spec for the command takes over from the command trie
+            if (!strchr(buffer, ' ') || !complete_arguments(buffer))
+                search_prefix(buffer);
+            TRACE_END(TRACE_COMPLETION, completion_start);
             printf("\r\033[K");
             prompt();
             printf("%s", buffer);
         }
         else if (c == '\033')
         {
-            getchar();
-            switch (getchar())
+            read_key();
+            switch (read_key())
             {
             case 'A': // Up arrow
                 if (current && current->next)
@@ -602,6 +985,7 @@ void readInput(char *buffer)
                 putchar(c);
             }
         }
+        TRACE_END(TRACE_KEYSTROKE, key_start);
     }
 }
 
@@ -615,24 +999,235 @@ void free_history(Node *head)
     }
 }
 
-int main()
+// Run a script, a -c string or piped input without touching the terminal
+// background jobs and scheduled tasks still run when a script ends, the shell stays around until they are done
+void wait_for_background_work()
+{
+    int jobs_left = unfinished_jobs();
+    if (jobs_left == 0 && next_task_timeout_ms() < 0 && running_task_count == 0)
+        return;
+    fprintf(stderr, "Waiting for %d background jobs, %d scheduled and %d running tasks\n", jobs_left, task_size, running_task_count);
+    struct pollfd wake = {job_queue_wake_fd(), POLLIN, 0};
+    while (1)
+    {
+        reap_jobs();
+        task_scheduler();
+        reap_tasks();
+        int timeout = next_task_timeout_ms();
+        if (unfinished_jobs() == 0 && timeout < 0 && running_task_count == 0)
+            break;
+        poll(&wake, 1, timeout);
+    }
+    for (int i = 0; i < job_count; i++)
+    {
+        if (jobs[i].status == STOPPED)
+            fprintf(stderr, "[%d] %s is stopped and was left behind\n", jobs[i].job_id, jobs[i].command);
+    }
+}
+
+int run_non_interactive(int argc, char **argv)
+{
+    bool bench = false;
+    int arg = 1;
+    int status;
+
+    interactive = false;
+    if (arg < argc && strcmp(argv[arg], "--bench") == 0)
+    {
+        bench = true;
+        arg++;
+    }
+
+    struct timespec started_at, finished_at;
+    clock_gettime(CLOCK_MONOTONIC, &started_at);
+    if (arg + 1 < argc && strcmp(argv[arg], "-c") == 0)
+    {
+        status = run_script_string(argv[arg + 1], strlen(argv[arg + 1]));
+    }
+    else if (arg < argc)
+    {
+        status = run_script_file(argv[arg]);
+    }
+    else
+    {
+        status = run_script_fd(STDIN_FILENO);
+    }
+    wait_for_background_work();
+    clock_gettime(CLOCK_MONOTONIC, &finished_at);
+
+    if (bench)
+    {
+        double elapsed = (finished_at.tv_sec - started_at.tv_sec) + (finished_at.tv_nsec - started_at.tv_nsec) / 1e9;
+        unsigned long lines = script_lines_executed();
+        fprintf(stderr, "%lu commands in %.3fs (%.0f commands/s)\n", lines, elapsed, elapsed > 0 ? lines / elapsed : 0.0);
+    }
+    return status;
+}
+
+// --startup-profile: each step from exec to the first prompt, recorded first and printed at the end
+StartupPhase startup_phases[STARTUP_MAX_PHASES];
+int startup_phase_count = 0;
+bool startup_profiling = false;
+struct timespec startup_mark;
+
+void startup_phase(const char *name, bool deferred)
+{
+    if (!startup_profiling || startup_phase_count == STARTUP_MAX_PHASES)
+        return;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    StartupPhase *phase = &startup_phases[startup_phase_count++];
+    phase->name = name;
+    phase->ms = (now.tv_sec - startup_mark.tv_sec) * 1e3 + (now.tv_nsec - startup_mark.tv_nsec) / 1e6;
+    phase->deferred = deferred;
+    startup_mark = now;
+}
+
+// Also time the subsystems that are now set up on first use and print every phase
+void finish_startup_profile()
+{
+    printf("\n");
+    fflush(stdout);
+    clock_gettime(CLOCK_MONOTONIC, &startup_mark);
+    seed_trie();
+    startup_phase("command trie", true);
+    completion_specs_load();
+    startup_phase("completion specs", true);
+    job_queue_init();
+    startup_phase("job queue", true);
+
+    for (int i = 0; i < startup_phase_count; i++)
+    {
+        if (!startup_phases[i].deferred)
+        {
+            fprintf(stderr, "%-20s %8.3f ms\n", startup_phases[i].name, startup_phases[i].ms);
+        }
+    }
+    fprintf(stderr, "deferred until first use:\n");
+    for (int i = 0; i < startup_phase_count; i++)
+    {
+        if (startup_phases[i].deferred)
+        {
+            fprintf(stderr, "%-20s %8.3f ms\n", startup_phases[i].name, startup_phases[i].ms);
+        }
+    }
+}
+
+// Start a fresh copy of the shell and time it from fork to its first prompt, so exec, dynamic linking and libc
+// setup are included; fails when that takes longer than budget_ms
+int run_startup_benchmark(const char *argv0, double budget_ms)
+{
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1)
+    {
+        perror("Failed to create pipe");
+        return EXIT_FAILURE;
+    }
+    struct timespec started_at, prompt_at;
+    clock_gettime(CLOCK_MONOTONIC, &started_at);
+    char clock[32];
+    snprintf(clock, sizeof(clock), "%lld", (long long)started_at.tv_sec * 1000000000LL + started_at.tv_nsec);
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("Failed to fork");
+        return EXIT_FAILURE;
+    }
+    if (pid == 0)
+    {
+        dup2(fds[1], STDOUT_FILENO);
+        setenv(STARTUP_CLOCK_ENV, clock, 1);
+        execl("/proc/self/exe", argv0, "--startup-profile", (char *)NULL);
+        execlp(argv0, argv0, "--startup-profile", (char *)NULL);
+        perror("Failed to start the shell");
+        _exit(127);
+    }
+    close(fds[1]);
+
+    // the first byte on the pipe is the prompt, the rest is read only to let the copy finish
+    bool prompted = false;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = read(fds[0], buffer, sizeof(buffer))) != 0)
+    {
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            break;
+        if (!prompted)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &prompt_at);
+            prompted = true;
+        }
+    }
+    close(fds[0]);
+    int status = 0;
+    while (waitpid(pid, &status, 0) == -1 && errno == EINTR)
+        ;
+    if (!prompted || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        fprintf(stderr, "The shell exited before showing a prompt\n");
+        return EXIT_FAILURE;
+    }
+
+    double total = (prompt_at.tv_sec - started_at.tv_sec) * 1e3 + (prompt_at.tv_nsec - started_at.tv_nsec) / 1e6;
+    fprintf(stderr, "%-20s %8.3f ms (budget %.3f ms)\n", "fork to prompt", total, budget_ms);
+    if (total > budget_ms)
+    {
+        fprintf(stderr, "Startup took %.3f ms, over the budget of %.3f ms\n", total, budget_ms);
+        return EXIT_FAILURE;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
 {
     char input[MAX_INPUT];
     history_head = NULL;
 
-    atexit(disableRawMode);
-    enableRawMode();
+    if (argc > 1 && strcmp(argv[1], "--startup-profile") == 0)
+    {
+        const char *launched_at = getenv(STARTUP_CLOCK_ENV);
+        if (!launched_at)
+        {
+            return run_startup_benchmark(argv[0], argc > 2 ? atof(argv[2]) : STARTUP_BUDGET_MS);
+        }
+        // the copy started by run_startup_benchmark, its clock began before the fork
+        long long ns = atoll(launched_at);
+        startup_mark.tv_sec = ns / 1000000000LL;
+        startup_mark.tv_nsec = ns % 1000000000LL;
+        unsetenv(STARTUP_CLOCK_ENV);
+        startup_profiling = true;
+        startup_phase("fork to main", false);
+    }
+    else if (argc > 1 || !isatty(STDIN_FILENO))
+    {
+        return run_non_interactive(argc, argv);
+    }
 
-    // adding common commands to the trie
-    int trie_index = 0;
-    while (common_commands[trie_index] != NULL)
+    if (isatty(STDIN_FILENO))
     {
-        insert_into_trie(common_commands[trie_index++]);
+        atexit(disableRawMode);
+        enableRawMode();
     }
+    startup_phase("raw mode", false);
 
+    // the job queue, command trie and completion specs are set up on first use, see finish_startup_profile()
     while (1)
     {
+        reap_jobs();
+        reap_tasks();
+        task_scheduler();
         prompt();
+        if (startup_profiling)
+        {
+            fflush(stdout);
+            startup_phase("first prompt", false);
+            finish_startup_profile();
+            return 0;
+        }
         readInput(input);
         history_head = add_to_history(history_head, input);
         exec_command(input);
@@ -1,6 +1,10 @@
 #ifndef SHELL_H
 #define SHELL_H
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,13 +19,17 @@
 #include <fcntl.h>
 #include <signal.h>
 #include <sys/wait.h>
+#include <time.h>
 
 #define ALPHABET_SIZE 26
 #define MAX_INPUT 1024
 #define MAX_ARGUMENTS 100
 #define MAX_WORDS_LENGTH 100
 #define COMMAND_SIZE 128
-#define MAX_JOBS 64
+#define MAX_JOBS 1024
+#define STARTUP_MAX_PHASES 16
+#define STARTUP_BUDGET_MS 10.0
+#define STARTUP_CLOCK_ENV "CUSTOM_SHELL_STARTUP_NS"
 
 #define RED   "\x1B[31m"
 #define GRN   "\x1B[32m"
@@ -33,6 +41,7 @@
 #define RESET "\x1B[0m"
 
 typedef enum {
+    QUEUED,
     RUNNING,
     STOPPED,
     TERMINATED
@@ -43,12 +52,17 @@ typedef struct {
     int job_id;
     job_status status;
     int priority;
-    char command[COMMAND_SIZE];
+    int slot;
+    bool reported;
+    struct timespec queued_at;
+    struct timespec started_at;
+    struct timespec finished_at;
+    char command[MAX_INPUT];
 } Job;
 
 
 typedef struct Node {
-    char command[COMMAND_SIZE];
+    char command[MAX_INPUT];
     struct Node *next;
     struct Node *prev;
 } Node;
@@ -58,9 +72,25 @@ typedef struct TrieNode {
 	bool is_end;
 } TrieNode;
 
+typedef struct {
+    const char *name;
+    double ms;
+    bool deferred;
+} StartupPhase;
+
+typedef void (*builtin_handler)(char **args, int arg_count);
+
+typedef struct {
+    const char *name;
+    builtin_handler handler;
+} Builtin;
+
+struct GlobExpansion;
+
 TrieNode* createNode();
 void insert_into_trie(const char* command);
 void collect_words(TrieNode* node, char* prefix, int length);
+void seed_trie();
 void search_prefix(char* prefix);
 void enableRawMode();
 void disableRawMode();
@@ -68,10 +98,29 @@ Node* add_to_history(Node *head, const char *command);
 void prompt();
 void sysusage();
 void change_directory(char **args);
+pid_t launch_command(char **args, int in_fd, int out_fd, int err_fd);
+Builtin *find_builtin(const char *name);
+bool is_builtin(char **args);
+int count_args(char **args);
+void run_builtin_with_fds(char **args, int in_fd, int out_fd);
+pid_t launch_builtin(char **args, int out_fd, int read_fd);
 void handle_redirection(char **args, char *file);
 void handle_pipeline(char **command1, char **command2);
+void handle_jobs(char **args, int arg_count, int priority);
+bool run_builtin(char **args, int arg_count);
+void handle_time(char *input);
+char *next_word(char **cursor);
+int expand_word(struct GlobExpansion *globs, char *token, char **words, int count, int limit);
+void run_onchange_line(char *input, struct GlobExpansion *globs);
+void run_command_line(char *input, struct GlobExpansion *globs);
 void exec_command(char *input);
+int read_key();
 void readInput(char *buffer);
 void free_history(Node *head);
+void wait_for_background_work();
+int run_non_interactive(int argc, char **argv);
+void startup_phase(const char *name, bool deferred);
+void finish_startup_profile();
+int run_startup_benchmark(const char *argv0, double budget_ms);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,82 @@
+#include "substitution.h"
+#include "shell.h"
+#include "command_stats.h"
+
+// text starts at "$(", returns the offset just past the matching ')' or 0 when there is none
+size_t substitution_end(const char *text) {
+    int depth = 0;
+    for (size_t i = 1; text[i]; i++) {
+        if (text[i] == '(')
+            depth++;
+        else if (text[i] == ')' && --depth == 0)
+            return i + 1;
+    }
+    return 0;
+}
+
+// doubling keeps the number of reallocs logarithmic, and large blocks are moved with mremap by glibc
+static void reserve(ExpandBuffer *buffer, size_t extra) {
+    if (buffer->length + extra + 1 <= buffer->capacity)
+        return;
+    size_t capacity = buffer->capacity > CAPTURE_INITIAL_SIZE ? buffer->capacity : CAPTURE_INITIAL_SIZE;
+    while (capacity < buffer->length + extra + 1)
+        capacity *= 2;
+    buffer->data = realloc(buffer->data, capacity);
+    if (!buffer->data) {
+        perror("Memory error");
+        exit(EXIT_FAILURE);
+    }
+    buffer->capacity = capacity;
+}
+
+// Run command in a subshell and append its output to buffer, trailing newlines are dropped
+bool capture_command(const char *command, size_t length, ExpandBuffer *buffer) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        perror("Failed to create pipe");
+        return false;
+    }
+
+    // a bigger pipe means fewer wakeups per megabyte captured, failing is harmless
+    fcntl(fds[0], F_SETPIPE_SZ, CAPTURE_PIPE_SIZE);
+
+    struct timespec started_at;
+    clock_gettime(CLOCK_MONOTONIC, &started_at);
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("Failed to fork");
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        char *line = strndup(command, length);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        exec_command(line);
+        fflush(stdout);
+        _exit(last_exit_status());
+    }
+    close(fds[1]);
+
+    // read straight into the buffer's spare capacity, there is no intermediate copy
+    size_t start = buffer->length;
+    while (1) {
+        reserve(buffer, CAPTURE_MIN_READ);
+        ssize_t n = read(fds[0], buffer->data + buffer->length, buffer->capacity - buffer->length - 1);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        buffer->length += n;
+    }
+    close(fds[0]);
+    wait_command(pid, 0, "$(...)", &started_at, NULL);
+
+    while (buffer->length > start && buffer->data[buffer->length - 1] == '\n')
+        buffer->length--;
+    buffer->data[buffer->length] = '\0';
+    return true;
+}
@@ -0,0 +1,25 @@
+#ifndef SUBSTITUTION_H
+#define SUBSTITUTION_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include "variables.h"
+
+#define CAPTURE_MIN_READ (64 * 1024)
+#define CAPTURE_INITIAL_SIZE (256 * 1024)
+#define CAPTURE_PIPE_SIZE (1024 * 1024)
+
+size_t substitution_end(const char *text);
+bool capture_command(const char *command, size_t length, ExpandBuffer *buffer);
+
+#endif
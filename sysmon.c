@@ -0,0 +1,424 @@
+#include "sysmon.h"
+
+// everything below is sized once when the monitor starts, sampling itself never allocates
+static char read_buffer[SYSMON_READ_SIZE];
+static char frame[SYSMON_FRAME_SIZE];
+static size_t frame_length;
+
+static int cpu_count;
+static CpuTicks *cpu_previous;
+static CpuTicks *cpu_current;
+
+static ProcessEntry *process_table;
+static ProcessEntry *process_next;
+static size_t process_capacity;
+static size_t process_count;
+static unsigned int generation;
+static ProcessEntry *top_processes[SYSMON_TOP_PROCESSES];
+static int top_count;
+
+static ssize_t read_proc(int fd, char *buffer, size_t size) {
+    ssize_t n = pread(fd, buffer, size - 1, 0);
+    if (n < 0)
+        return -1;
+    buffer[n] = '\0';
+    return n;
+}
+
+static unsigned long long parse_number(const char **cursor) {
+    const char *p = *cursor;
+    unsigned long long value = 0;
+    while (*p == ' ' || *p == '\t')
+        p++;
+    while (*p >= '0' && *p <= '9')
+        value = value * 10 + (*p++ - '0');
+    *cursor = p;
+    return value;
+}
+
+static void skip_fields(const char **cursor, int count) {
+    const char *p = *cursor;
+    while (count-- > 0) {
+        while (*p == ' ')
+            p++;
+        while (*p && *p != ' ')
+            p++;
+    }
+    *cursor = p;
+}
+
+static const char *next_line_start(const char *p) {
+    while (*p && *p != '\n')
+        p++;
+    return *p ? p + 1 : p;
+}
+
+// index 0 is the aggregate "cpu" line, 1..cpu_count are the cores
+static void sample_cpus(int stat_fd, CpuTicks *ticks) {
+    if (read_proc(stat_fd, read_buffer, sizeof(read_buffer)) < 0)
+        return;
+    const char *p = read_buffer;
+    int index = 0;
+    while (index <= cpu_count && strncmp(p, "cpu", 3) == 0) {
+        p += 3;
+        while (*p >= '0' && *p <= '9')
+            p++;
+        unsigned long long user = parse_number(&p), nice = parse_number(&p), system = parse_number(&p);
+        unsigned long long idle = parse_number(&p), iowait = parse_number(&p), irq = parse_number(&p);
+        unsigned long long softirq = parse_number(&p), steal = parse_number(&p);
+        ticks[index].busy = user + nice + system + irq + softirq + steal;
+        ticks[index].total = ticks[index].busy + idle + iowait;
+        index++;
+        p = next_line_start(p);
+    }
+}
+
+static int count_cpus(int stat_fd) {
+    if (read_proc(stat_fd, read_buffer, sizeof(read_buffer)) < 0)
+        return 0;
+    int count = 0;
+    const char *p = next_line_start(read_buffer);
+    while (strncmp(p, "cpu", 3) == 0) {
+        count++;
+        p = next_line_start(p);
+    }
+    return count;
+}
+
+static double cpu_percent(int index) {
+    unsigned long long total = cpu_current[index].total - cpu_previous[index].total;
+    unsigned long long busy = cpu_current[index].busy - cpu_previous[index].busy;
+    return total ? busy * 100.0 / total : 0.0;
+}
+
+static unsigned long long meminfo_value(const char *key) {
+    const char *found = strstr(read_buffer, key);
+    if (!found)
+        return 0;
+    found += strlen(key);
+    return parse_number(&found);
+}
+
+static void frame_printf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+static void frame_printf(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(frame + frame_length, sizeof(frame) - frame_length, format, args);
+    va_end(args);
+    if (n > 0)
+        frame_length += (size_t)n < sizeof(frame) - frame_length ? (size_t)n : sizeof(frame) - frame_length - 1;
+}
+
+static ProcessEntry *process_slot(ProcessEntry *table, pid_t pid) {
+    size_t mask = process_capacity - 1;
+    size_t i = ((size_t)pid * 2654435761u) & mask;
+    while (table[i].pid != 0 && table[i].pid != pid)
+        i = (i + 1) & mask;
+    return &table[i];
+}
+
+static ProcessEntry *rehash_table(ProcessEntry *old, size_t old_capacity) {
+    ProcessEntry *table = calloc(process_capacity, sizeof(ProcessEntry));
+    if (!table) {
+        perror("Memory error");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i].pid != 0)
+            *process_slot(table, old[i].pid) = old[i];
+    }
+    free(old);
+    return table;
+}
+
+// only happens when the process count reaches a new high
+static void grow_process_tables() {
+    size_t old_capacity = process_capacity;
+    process_capacity *= 2;
+    process_table = rehash_table(process_table, old_capacity);
+    process_next = rehash_table(process_next, old_capacity);
+}
+
+// /proc/<pid>/stat: "pid (comm) state ppid ... utime stime ... rss"
+static bool parse_process_stat(ProcessEntry *entry, unsigned long long *ticks) {
+    if (read_proc(entry->fd, read_buffer, sizeof(read_buffer)) <= 0)
+        return false;
+    const char *open = strchr(read_buffer, '(');
+    const char *close = strrchr(read_buffer, ')');
+    if (!open || !close)
+        return false;
+    size_t comm_length = close - open - 1;
+    if (comm_length >= SYSMON_COMM_SIZE)
+        comm_length = SYSMON_COMM_SIZE - 1;
+    memcpy(entry->comm, open + 1, comm_length);
+    entry->comm[comm_length] = '\0';
+
+    const char *p = close + 1;
+    skip_fields(&p, 11);
+    unsigned long long utime = parse_number(&p);
+    unsigned long long stime = parse_number(&p);
+    skip_fields(&p, 8);
+    entry->rss_pages = (long)parse_number(&p);
+    *ticks = utime + stime;
+    return true;
+}
+
+static void consider_top(ProcessEntry *entry) {
+    int position = top_count;
+    if (top_count < SYSMON_TOP_PROCESSES)
+        top_count++;
+    else if (entry->cpu_percent <= top_processes[top_count - 1]->cpu_percent)
+        return;
+    else
+        position = top_count - 1;
+    while (position > 0 && top_processes[position - 1]->cpu_percent < entry->cpu_percent) {
+        top_processes[position] = top_processes[position - 1];
+        position--;
+    }
+    top_processes[position] = entry;
+}
+
+// rebuild the pid table from /proc, keeping the stat fds of processes that are still alive
+static void refresh_processes(int proc_fd, double elapsed, long ticks_per_second) {
+    char dirents[SYSMON_READ_SIZE];
+    size_t alive = 0;
+    generation++;
+    top_count = 0;
+    lseek(proc_fd, 0, SEEK_SET);
+
+    while (1) {
+        long n = syscall(SYS_getdents64, proc_fd, dirents, sizeof(dirents));
+        if (n <= 0)
+            break;
+        for (long offset = 0; offset < n;) {
+            struct dirent64 *entry = (struct dirent64 *)(dirents + offset);
+            offset += entry->d_reclen;
+            if (entry->d_name[0] < '1' || entry->d_name[0] > '9')
+                continue;
+            pid_t pid = (pid_t)strtol(entry->d_name, NULL, 10);
+
+            if ((alive + 1) * 2 > process_capacity)
+                grow_process_tables();
+            ProcessEntry *previous = process_slot(process_table, pid);
+            ProcessEntry *current = process_slot(process_next, pid);
+            if (previous->pid == pid) {
+                *current = *previous;
+                previous->generation = generation;
+            } else {
+                char path[32];
+                snprintf(path, sizeof(path), "%d/stat", pid);
+                memset(current, 0, sizeof(*current));
+                current->pid = pid;
+                current->fd = openat(proc_fd, path, O_RDONLY | O_CLOEXEC);
+                current->ticks = (unsigned long long)-1;
+                if (current->fd < 0) {
+                    current->pid = 0;
+                    continue;
+                }
+            }
+
+            unsigned long long ticks;
+            if (!parse_process_stat(current, &ticks)) {
+                close(current->fd);
+                current->pid = 0;
+                continue;
+            }
+            current->cpu_percent = current->ticks == (unsigned long long)-1 || elapsed <= 0
+                                       ? 0.0
+                                       : (ticks - current->ticks) * 100.0 / (elapsed * ticks_per_second);
+            current->ticks = ticks;
+            current->generation = generation;
+            alive++;
+        }
+    }
+
+    // whatever was not carried over has exited
+    for (size_t i = 0; i < process_capacity; i++) {
+        if (process_table[i].pid != 0 && process_table[i].generation != generation)
+            close(process_table[i].fd);
+    }
+    memset(process_table, 0, process_capacity * sizeof(ProcessEntry));
+    ProcessEntry *swap = process_table;
+    process_table = process_next;
+    process_next = swap;
+    process_count = alive;
+
+    for (size_t i = 0; i < process_capacity; i++) {
+        if (process_table[i].pid != 0)
+            consider_top(&process_table[i]);
+    }
+}
+
+static double monotonic_seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static double self_cpu_seconds() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+static void render(int meminfo_fd, int loadavg_fd, long page_size, double monitor_percent, bool clear) {
+    frame_length = 0;
+    if (clear)
+        frame_printf("\033[H\033[2J");
+
+    if (read_proc(loadavg_fd, read_buffer, sizeof(read_buffer)) > 0) {
+        const char *end = read_buffer;
+        skip_fields(&end, 3);
+        frame_printf("Load average:%.*s\n", (int)(end - read_buffer), read_buffer);
+    }
+
+    frame_printf("CPU %5.1f%%\n", cpu_percent(0));
+    for (int i = 1; i <= cpu_count; i++) {
+        frame_printf("%4d %5.1f%%%s", i - 1, cpu_percent(i), i % 8 == 0 || i == cpu_count ? "\n" : "  ");
+    }
+
+    if (read_proc(meminfo_fd, read_buffer, sizeof(read_buffer)) > 0) {
+        unsigned long long total = meminfo_value("MemTotal:"), available = meminfo_value("MemAvailable:");
+        unsigned long long swap_total = meminfo_value("SwapTotal:"), swap_free = meminfo_value("SwapFree:");
+        frame_printf("Mem:  %.2f / %.2f MB used\n", (total - available) / 1024.0, total / 1024.0);
+        frame_printf("Swap: %.2f / %.2f MB used\n", (swap_total - swap_free) / 1024.0, swap_total / 1024.0);
+    }
+
+    frame_printf("\n%8s %-16s %6s %10s   (%zu processes)\n", "PID", "COMMAND", "CPU%", "RSS(MB)", process_count);
+    for (int i = 0; i < top_count; i++) {
+        ProcessEntry *entry = top_processes[i];
+        frame_printf("%8d %-16s %6.1f %10.1f\n", entry->pid, entry->comm, entry->cpu_percent,
+                     entry->rss_pages * (double)page_size / (1024 * 1024));
+    }
+    frame_printf("\nmonitor: %.2f%% of a core%s\n", monitor_percent, clear ? ", press q to quit" : "");
+
+    size_t written = 0;
+    while (written < frame_length) {
+        ssize_t n = write(STDOUT_FILENO, frame + written, frame_length - written);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR)
+                continue;
+            break;
+        }
+        written += n;
+    }
+}
+
+// sleep for the interval, returns true when the user asked to quit
+static bool wait_or_quit(double seconds, bool keyboard) {
+    struct pollfd fd = {STDIN_FILENO, POLLIN, 0};
+    int timeout = (int)(seconds * 1000);
+    if (!keyboard) {
+        struct timespec delay = {(time_t)seconds, (long)((seconds - (time_t)seconds) * 1e9)};
+        nanosleep(&delay, NULL);
+        return false;
+    }
+    if (poll(&fd, 1, timeout) > 0) {
+        char c;
+        if (read(STDIN_FILENO, &c, 1) != 1 || c == 'q' || c == 'Q')
+            return true;
+    }
+    return false;
+}
+
+// the file limit from before the monitor raised it, put back so children don't inherit the raised one
+static struct rlimit saved_nofile_limit;
+static bool nofile_limit_raised = false;
+
+static void close_monitor(int *fds, int count) {
+    for (int i = 0; i < count; i++) {
+        if (fds[i] >= 0)
+            close(fds[i]);
+    }
+    for (size_t i = 0; i < process_capacity; i++) {
+        if (process_table[i].pid != 0)
+            close(process_table[i].fd);
+    }
+    free(process_table);
+    free(process_next);
+    free(cpu_previous);
+    free(cpu_current);
+    process_table = process_next = NULL;
+    cpu_previous = cpu_current = NULL;
+    process_capacity = process_count = 0;
+    if (nofile_limit_raised) {
+        setrlimit(RLIMIT_NOFILE, &saved_nofile_limit);
+        nofile_limit_raised = false;
+    }
+}
+
+// sysusage --watch [-n seconds] [-c count]
+void sysusage_watch(char **args, int arg_count) {
+    double interval = 1.0;
+    long iterations = -1;
+    for (int i = 2; i + 1 < arg_count; i += 2) {
+        if (strcmp(args[i], "-n") == 0)
+            interval = atof(args[i + 1]);
+        else if (strcmp(args[i], "-c") == 0)
+            iterations = atol(args[i + 1]);
+    }
+    if (interval < SYSMON_MIN_INTERVAL)
+        interval = SYSMON_MIN_INTERVAL;
+
+    // one stat fd per process, so allow as many as the hard limit permits
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        saved_nofile_limit = limit;
+        limit.rlim_cur = limit.rlim_max;
+        nofile_limit_raised = setrlimit(RLIMIT_NOFILE, &limit) == 0;
+    }
+
+    int fds[4] = {
+        open("/proc/stat", O_RDONLY | O_CLOEXEC),
+        open("/proc/meminfo", O_RDONLY | O_CLOEXEC),
+        open("/proc/loadavg", O_RDONLY | O_CLOEXEC),
+        open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC)};
+    if (fds[0] < 0 || fds[1] < 0 || fds[2] < 0 || fds[3] < 0) {
+        perror("Failed to open /proc");
+        close_monitor(fds, 4);
+        return;
+    }
+
+    cpu_count = count_cpus(fds[0]);
+    cpu_previous = calloc(cpu_count + 1, sizeof(CpuTicks));
+    cpu_current = calloc(cpu_count + 1, sizeof(CpuTicks));
+    process_capacity = 4096;
+    process_table = calloc(process_capacity, sizeof(ProcessEntry));
+    process_next = calloc(process_capacity, sizeof(ProcessEntry));
+    long ticks_per_second = sysconf(_SC_CLK_TCK);
+    long page_size = sysconf(_SC_PAGESIZE);
+    bool keyboard = isatty(STDIN_FILENO);
+    bool clear = isatty(STDOUT_FILENO);
+
+    double last_proc = monotonic_seconds();
+    double last_frame = last_proc, last_cpu = self_cpu_seconds();
+    sample_cpus(fds[0], cpu_current);
+    refresh_processes(fds[3], 0, ticks_per_second);
+
+    while (iterations != 0) {
+        if (wait_or_quit(interval, keyboard))
+            break;
+        CpuTicks *swap = cpu_previous;
+        cpu_previous = cpu_current;
+        cpu_current = swap;
+        sample_cpus(fds[0], cpu_current);
+
+        // the per-process scan is the expensive part, so it runs at most once a second
+        double now = monotonic_seconds();
+        if (now - last_proc >= SYSMON_PROC_INTERVAL - interval / 2) {
+            refresh_processes(fds[3], now - last_proc, ticks_per_second);
+            last_proc = now;
+        }
+
+        double cpu = self_cpu_seconds();
+        double monitor_percent = now > last_frame ? (cpu - last_cpu) * 100.0 / (now - last_frame) : 0.0;
+        last_frame = now;
+        last_cpu = cpu;
+        render(fds[1], fds[2], page_size, monitor_percent, clear);
+        if (!clear)
+            write(STDOUT_FILENO, "\n", 1);
+        if (iterations > 0)
+            iterations--;
+    }
+    close_monitor(fds, 4);
+}
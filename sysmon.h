@@ -0,0 +1,47 @@
+#ifndef SYSMON_H
+#define SYSMON_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+
+#define SYSMON_MIN_INTERVAL 0.1
+#define SYSMON_PROC_INTERVAL 1.0
+#define SYSMON_TOP_PROCESSES 10
+#define SYSMON_READ_SIZE 65536
+#define SYSMON_FRAME_SIZE 65536
+#define SYSMON_COMM_SIZE 16
+
+typedef struct {
+    unsigned long long busy;
+    unsigned long long total;
+} CpuTicks;
+
+typedef struct {
+    pid_t pid;
+    int fd;
+    unsigned int generation;
+    unsigned long long ticks;
+    double cpu_percent;
+    long rss_pages;
+    char comm[SYSMON_COMM_SIZE];
+} ProcessEntry;
+
+void sysusage_watch(char **args, int arg_count);
+
+#endif
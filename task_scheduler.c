@@ -2,6 +2,10 @@
 
 int task_size = 0;
 Task tasks[MAX_TASKS];
+RunningTask running_tasks[MAX_TASKS];
+int running_task_count = 0;
+// forked subshells inherit the heap, only the shell that scheduled the tasks may fire them
+pid_t scheduler_pid = 0;
 
 void swap(Task *t1, Task *t2) {
     Task temp = *t1;
@@ -60,29 +64,62 @@ void print_tasks() {
     }
 }
 
+// fired tasks run in the background, reap_tasks() collects them
 void execute_task(Task task) {
-    pid_t pid = fork();
-    if (pid == 0) {
-        time_t current_time = time(NULL);
-        if (current_time < task.execution_time) {
-            sleep(task.execution_time - current_time);
-        }
-        printf("Executing: %s\n", task.command);
-        system(task.command);
-        printf("Successfully executed: %s\n", task.command);
+    if (running_task_count == MAX_TASKS) {
+        fprintf(stderr, "Too many running tasks, skipping: %s\n", task.command);
+        return;
+    }
+    char *argv[] = {TASK_SHELL, "-c", task.command, NULL};
+    RunningTask *running = &running_tasks[running_task_count];
+
+    printf("Executing: %s\n", task.command);
+    clock_gettime(CLOCK_MONOTONIC, &running->started_at);
+    running->pid = launch_command(argv, -1, -1, -1);
+    if (running->pid > 0) {
+        strcpy(running->command, task.command);
+        running_task_count++;
     }
 }
 
+// fire every task that is due
 void task_scheduler() {
+    if (task_size == 0 || getpid() != scheduler_pid)
+        return;
+    time_t current_time = time(NULL);
+    while (task_size > 0 && tasks[0].execution_time <= current_time) {
+        TRACE_BEGIN(fire_start);
         Task task = pop();
         execute_task(task);
+        TRACE_END(TRACE_SCHEDULER, fire_start);
     }
+}
 
+// milliseconds until the next task is due, -1 when nothing is scheduled
+int next_task_timeout_ms() {
+    if (task_size == 0 || getpid() != scheduler_pid)
+        return -1;
+    time_t delay = tasks[0].execution_time - time(NULL);
+    return delay > 0 ? (int)(delay * 1000) : 0;
+}
+
+void reap_tasks() {
+    for (int i = 0; i < running_task_count; i++) {
+        CommandUsage usage;
+        char name[MAX_COMMAND_SIZE] = "";
+        sscanf(running_tasks[i].command, "%255s", name);
+        if (reap_command(running_tasks[i].pid, WNOHANG, name, &running_tasks[i].started_at, &usage) != running_tasks[i].pid)
+            continue;
+        printf("Successfully executed: %s (exit %d, %.2fs)\n", running_tasks[i].command, usage.exit_status, usage.wall_time);
+        running_tasks[i--] = running_tasks[--running_task_count];
+    }
+}
 
 void add_task(char* command, time_t exec_time) {
     Task new_task;
     strncpy(new_task.command, command, MAX_COMMAND_SIZE);
     new_task.execution_time = exec_time;
+    scheduler_pid = getpid();
     push(new_task);
     print_tasks();
     task_scheduler();
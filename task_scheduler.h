@@ -7,18 +7,29 @@
 #include <time.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include "command_stats.h"
 
 #define MAX_COMMAND_SIZE 256
 #define MAX_TASKS 100
+#define TASK_SHELL "/bin/sh"
 
 typedef struct Task {
     char command[MAX_COMMAND_SIZE];
     time_t execution_time;
 } Task;
 
+typedef struct RunningTask {
+    pid_t pid;
+    char command[MAX_COMMAND_SIZE];
+    struct timespec started_at;
+} RunningTask;
+
 void push(Task task);            
 Task pop();                      
 void execute_task(Task task);    
 void task_scheduler();          
 void add_task(char* command, time_t exec_time);  
+void print_tasks();
+int next_task_timeout_ms();
+void reap_tasks();
 #endif
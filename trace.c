@@ -0,0 +1,156 @@
+#include "trace.h"
+
+atomic_bool trace_enabled = false;
+
+// every thread's buffer, pushed once with a CAS and never removed
+_Atomic(TraceBuffer *) trace_buffers = NULL;
+static __thread TraceBuffer *thread_buffer = NULL;
+
+const char *TRACE_POINT_NAMES[TRACE_POINT_COUNT] = {
+    "keystroke",
+    "completion",
+    "parse",
+    "spawn",
+    "wait",
+    "redirect",
+    "scheduler",
+    "glob",
+};
+
+uint64_t trace_now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+static TraceBuffer *get_thread_buffer() {
+    if (thread_buffer)
+        return thread_buffer;
+
+    TraceBuffer *buffer = calloc(1, sizeof(TraceBuffer));
+    if (!buffer)
+        return NULL;
+    buffer->tid = syscall(SYS_gettid);
+    buffer->next = atomic_load(&trace_buffers);
+    while (!atomic_compare_exchange_weak(&trace_buffers, &buffer->next, buffer))
+        ;
+    thread_buffer = buffer;
+    return buffer;
+}
+
+static int bucket_for(uint64_t duration_ns) {
+    return duration_ns ? 63 - __builtin_clzll(duration_ns) : 0;
+}
+
+void trace_record(trace_point point, uint64_t start_ns) {
+    uint64_t duration = trace_now_ns() - start_ns;
+    TraceBuffer *buffer = get_thread_buffer();
+    if (!buffer)
+        return;
+
+    unsigned long head = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+    TraceEvent *event = &buffer->events[head % TRACE_RING_SIZE];
+    event->start_ns = start_ns;
+    event->duration_ns = duration;
+    event->point = point;
+    buffer->histogram[point][bucket_for(duration)]++;
+    atomic_store_explicit(&buffer->head, head + 1, memory_order_release);
+}
+
+static void format_duration(uint64_t ns, char *out, size_t size) {
+    if (ns < 1000)
+        snprintf(out, size, "%lluns", (unsigned long long)ns);
+    else if (ns < 1000000)
+        snprintf(out, size, "%lluus", (unsigned long long)ns / 1000);
+    else if (ns < 1000000000)
+        snprintf(out, size, "%llums", (unsigned long long)ns / 1000000);
+    else
+        snprintf(out, size, "%llus", (unsigned long long)ns / 1000000000);
+}
+
+static void print_histograms() {
+    uint64_t merged[TRACE_POINT_COUNT][TRACE_BUCKETS] = {{0}};
+    for (TraceBuffer *buffer = atomic_load(&trace_buffers); buffer; buffer = buffer->next) {
+        for (int p = 0; p < TRACE_POINT_COUNT; p++)
+            for (int b = 0; b < TRACE_BUCKETS; b++)
+                merged[p][b] += buffer->histogram[p][b];
+    }
+
+    for (int p = 0; p < TRACE_POINT_COUNT; p++) {
+        uint64_t total = 0, peak = 0;
+        for (int b = 0; b < TRACE_BUCKETS; b++) {
+            total += merged[p][b];
+            if (merged[p][b] > peak)
+                peak = merged[p][b];
+        }
+        if (total == 0)
+            continue;
+
+        printf("%s (%llu samples)\n", TRACE_POINT_NAMES[p], (unsigned long long)total);
+        for (int b = 0; b < TRACE_BUCKETS; b++) {
+            if (merged[p][b] == 0)
+                continue;
+            char low[16], high[16];
+            format_duration(1ull << b, low, sizeof(low));
+            format_duration(b == 63 ? UINT64_MAX : 1ull << (b + 1), high, sizeof(high));
+            int bar = (int)(merged[p][b] * 40 / peak);
+            printf("  [%6s, %6s) %8llu %.*s\n", low, high, (unsigned long long)merged[p][b], bar > 0 ? bar : 1,
+                   "########################################");
+        }
+    }
+}
+
+// Chrome trace-event format, loadable in chrome://tracing or Perfetto
+static int write_chrome_trace(const char *path) {
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        perror("Failed to open trace file");
+        return -1;
+    }
+
+    int written = 0;
+    pid_t pid = getpid();
+    fprintf(out, "{\"traceEvents\":[");
+    for (TraceBuffer *buffer = atomic_load(&trace_buffers); buffer; buffer = buffer->next) {
+        unsigned long head = atomic_load_explicit(&buffer->head, memory_order_acquire);
+        unsigned long first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+        for (unsigned long i = first; i < head; i++) {
+            const TraceEvent *event = &buffer->events[i % TRACE_RING_SIZE];
+            fprintf(out, "%s\n{\"name\":\"%s\",\"cat\":\"shell\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d}",
+                    written++ ? "," : "", TRACE_POINT_NAMES[event->point], event->start_ns / 1000.0,
+                    event->duration_ns / 1000.0, pid, buffer->tid);
+        }
+    }
+    fprintf(out, "\n],\"displayTimeUnit\":\"ns\"}\n");
+    fclose(out);
+    return written;
+}
+
+static void reset_trace() {
+    for (TraceBuffer *buffer = atomic_load(&trace_buffers); buffer; buffer = buffer->next) {
+        atomic_store(&buffer->head, 0);
+        memset(buffer->histogram, 0, sizeof(buffer->histogram));
+    }
+}
+
+void handle_trace(char **args, int arg_count) {
+    if (arg_count < 2) {
+        printf("Tracing is %s. Usage: trace on|off|reset|dump [file]\n", atomic_load(&trace_enabled) ? "on" : "off");
+        return;
+    }
+    if (strcmp(args[1], "on") == 0) {
+        atomic_store(&trace_enabled, true);
+    } else if (strcmp(args[1], "off") == 0) {
+        atomic_store(&trace_enabled, false);
+    } else if (strcmp(args[1], "reset") == 0) {
+        reset_trace();
+    } else if (strcmp(args[1], "dump") == 0) {
+        const char *path = arg_count > 2 ? args[2] : TRACE_DEFAULT_FILE;
+        int events = write_chrome_trace(path);
+        if (events >= 0)
+            printf("Wrote %d events to %s\n", events, path);
+        print_histograms();
+    } else {
+        fprintf(stderr, "Invalid argument, use 'on', 'off', 'reset' or 'dump'\n");
+    }
+}
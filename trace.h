@@ -0,0 +1,64 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#define TRACE_RING_SIZE 65536
+#define TRACE_BUCKETS 64
+#define TRACE_DEFAULT_FILE "trace.json"
+
+typedef enum {
+    TRACE_KEYSTROKE,
+    TRACE_COMPLETION,
+    TRACE_PARSE,
+    TRACE_SPAWN,
+    TRACE_WAIT,
+    TRACE_REDIRECT,
+    TRACE_SCHEDULER,
+    TRACE_GLOB,
+    TRACE_POINT_COUNT
+} trace_point;
+
+typedef struct {
+    uint64_t start_ns;
+    uint64_t duration_ns;
+    trace_point point;
+} TraceEvent;
+
+// one per thread, only that thread writes to it
+typedef struct TraceBuffer {
+    pid_t tid;
+    atomic_ulong head;
+    TraceEvent events[TRACE_RING_SIZE];
+    uint64_t histogram[TRACE_POINT_COUNT][TRACE_BUCKETS];
+    struct TraceBuffer *next;
+} TraceBuffer;
+
+extern atomic_bool trace_enabled;
+
+uint64_t trace_now_ns();
+void trace_record(trace_point point, uint64_t start_ns);
+void handle_trace(char **args, int arg_count);
+
+// a disabled trace point costs one relaxed load and a predictable branch
+#define TRACE_ON() __builtin_expect(atomic_load_explicit(&trace_enabled, memory_order_relaxed), 0)
+#define TRACE_BEGIN(var) uint64_t var = TRACE_ON() ? trace_now_ns() : 0
+#define TRACE_END(point, var)              \
+    do {                                   \
+        if (TRACE_ON() && (var) != 0)      \
+            trace_record((point), (var));  \
+    } while (0)
+
+#endif
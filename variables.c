@@ -0,0 +1,335 @@
+#include "variables.h"
+#include "command_stats.h"
+#include "substitution.h"
+
+extern char **environ;
+
+static ShellVariable *variables = NULL;
+static size_t variable_capacity = 0;
+static size_t variable_count = 0;
+
+// envp handed to every child, only rebuilt after an exported variable changed
+static char **envp_cache = NULL;
+static char *envp_strings = NULL;
+static bool envp_dirty = true;
+
+static uint64_t hash_name(const char *name) {
+    uint64_t hash = 1469598103934665603ull;
+    for (; *name; name++) {
+        hash ^= (unsigned char)*name;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static ShellVariable *variable_slot(ShellVariable *table, size_t capacity, const char *name) {
+    size_t mask = capacity - 1;
+    size_t i = hash_name(name) & mask;
+    while (table[i].name && strcmp(table[i].name, name) != 0)
+        i = (i + 1) & mask;
+    return &table[i];
+}
+
+static void grow_variables() {
+    size_t capacity = variable_capacity ? variable_capacity * 2 : VARIABLE_TABLE_SIZE;
+    ShellVariable *table = calloc(capacity, sizeof(ShellVariable));
+    if (!table) {
+        perror("Memory error");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < variable_capacity; i++) {
+        if (variables[i].name)
+            *variable_slot(table, capacity, variables[i].name) = variables[i];
+    }
+    free(variables);
+    variables = table;
+    variable_capacity = capacity;
+}
+
+static ShellVariable *find_variable(const char *name, bool create) {
+    if (variable_capacity == 0 && !create)
+        return NULL;
+    if (create && (variable_count + 1) * 2 > variable_capacity)
+        grow_variables();
+    ShellVariable *variable = variable_slot(variables, variable_capacity, name);
+    if (!variable->name) {
+        if (!create)
+            return NULL;
+        variable->name = strdup(name);
+        variable_count++;
+    }
+    return variable;
+}
+
+// the inherited environment is only copied into the table once the shell first touches a variable
+static void load_environment() {
+    if (variable_capacity > 0)
+        return;
+    grow_variables();
+    for (char **entry = environ; *entry; entry++) {
+        char *equals = strchr(*entry, '=');
+        if (!equals || equals == *entry)
+            continue;
+        char *name = strndup(*entry, equals - *entry);
+        ShellVariable *variable = find_variable(name, true);
+        free(variable->value);
+        variable->value = strdup(equals + 1);
+        variable->exported = true;
+        free(name);
+    }
+}
+
+// $? and the other status variables come first, they cannot be assigned
+const char *get_variable(const char *name) {
+    const char *value = status_variable(name);
+    if (value)
+        return value;
+    if (variable_capacity == 0)
+        return getenv(name);
+    ShellVariable *variable = find_variable(name, false);
+    return variable ? variable->value : NULL;
+}
+
+void set_variable(const char *name, const char *value, bool exported) {
+    load_environment();
+    ShellVariable *variable = find_variable(name, true);
+    char *copy = strdup(value);
+    free(variable->value);
+    variable->value = copy;
+    variable->exported = variable->exported || exported;
+    if (variable->exported) {
+        // keep getenv() users (PATH lookup, HOME, FOCUS_HOSTS_FILE) in step with the table
+        setenv(name, value, 1);
+        envp_dirty = true;
+    }
+}
+
+void unset_variable(const char *name) {
+    load_environment();
+    ShellVariable *variable = find_variable(name, false);
+    if (!variable || !variable->value)
+        return;
+    if (variable->exported) {
+        unsetenv(name);
+        envp_dirty = true;
+    }
+    free(variable->value);
+    variable->value = NULL;
+    variable->exported = false;
+}
+
+static bool is_name_start(char c) {
+    return isalpha((unsigned char)c) || c == '_';
+}
+
+static bool is_name_char(char c) {
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+static size_t name_length(const char *text) {
+    if (!is_name_start(text[0]))
+        return 0;
+    size_t length = 1;
+    while (is_name_char(text[length]))
+        length++;
+    return length;
+}
+
+bool is_assignment(const char *word) {
+    size_t length = name_length(word);
+    return length > 0 && word[length] == '=';
+}
+
+// NAME=value, returns false when the part before '=' is not a valid name
+bool assign_variable(const char *assignment, bool exported) {
+    if (!is_assignment(assignment))
+        return false;
+    size_t length = name_length(assignment);
+    char *name = strndup(assignment, length);
+    set_variable(name, assignment + length + 1, exported);
+    free(name);
+    return true;
+}
+
+char **variable_envp() {
+    if (variable_capacity == 0)
+        return environ;
+    if (!envp_dirty)
+        return envp_cache;
+
+    size_t count = 0, size = 0;
+    for (size_t i = 0; i < variable_capacity; i++) {
+        ShellVariable *variable = &variables[i];
+        if (variable->name && variable->value && variable->exported) {
+            count++;
+            size += strlen(variable->name) + strlen(variable->value) + 2;
+        }
+    }
+    char **envp = realloc(envp_cache, (count + 1) * sizeof(char *));
+    char *strings = realloc(envp_strings, size ? size : 1);
+    if (!envp || !strings) {
+        perror("Memory error");
+        exit(EXIT_FAILURE);
+    }
+    envp_cache = envp;
+    envp_strings = strings;
+
+    count = 0;
+    for (size_t i = 0; i < variable_capacity; i++) {
+        ShellVariable *variable = &variables[i];
+        if (!variable->name || !variable->value || !variable->exported)
+            continue;
+        envp[count++] = strings;
+        strings += sprintf(strings, "%s=%s", variable->name, variable->value) + 1;
+    }
+    envp[count] = NULL;
+    envp_dirty = false;
+    return envp;
+}
+
+static void buffer_append(ExpandBuffer *buffer, const char *data, size_t length) {
+    if (buffer->length + length + 1 > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 64;
+        while (capacity < buffer->length + length + 1)
+            capacity *= 2;
+        buffer->data = realloc(buffer->data, capacity);
+        if (!buffer->data) {
+            perror("Memory error");
+            exit(EXIT_FAILURE);
+        }
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+    buffer->data[buffer->length] = '\0';
+}
+
+static void append_variable(ExpandBuffer *buffer, const char *name, size_t length) {
+    char *copy = strndup(name, length);
+    const char *value = get_variable(copy);
+    if (value)
+        buffer_append(buffer, value, strlen(value));
+    free(copy);
+}
+
+// ${NAME} or ${NAME:-default}, returns the length consumed or 0 when the braces are not closed
+static size_t expand_braced(ExpandBuffer *buffer, const char *text) {
+    const char *close = strchr(text, '}');
+    size_t length = name_length(text + 2);
+    if (!close || length == 0)
+        return 0;
+    const char *name = text + 2, *after = name + length;
+    if (after == close) {
+        append_variable(buffer, name, length);
+    } else if (after[0] == ':' && after[1] == '-') {
+        char *copy = strndup(name, length);
+        const char *value = get_variable(copy);
+        free(copy);
+        if (value && *value) {
+            buffer_append(buffer, value, strlen(value));
+        } else {
+            char *fallback = strndup(after + 2, close - after - 2);
+            char *expanded = expand_variables(fallback);
+            const char *result = expanded ? expanded : fallback;
+            buffer_append(buffer, result, strlen(result));
+            free(expanded);
+            free(fallback);
+        }
+    } else {
+        return 0;
+    }
+    return close - text + 1;
+}
+
+// $(command) or `command`, returns the length consumed or 0 when it is not closed
+static size_t expand_substitution(ExpandBuffer *buffer, const char *text) {
+    if (text[0] == '`') {
+        const char *close = strchr(text + 1, '`');
+        if (!close)
+            return 0;
+        capture_command(text + 1, close - text - 1, buffer);
+        return close - text + 1;
+    }
+    size_t end = substitution_end(text);
+    if (end == 0)
+        return 0;
+    capture_command(text + 2, end - 3, buffer);
+    return end;
+}
+
+// Replace $NAME, ${NAME}, ${NAME:-default}, $(command) and `command` in word, returns NULL when word has nothing to expand
+char *expand_variables(const char *word) {
+    const char *special = strpbrk(word, "$`");
+    if (!special)
+        return NULL;
+
+    ExpandBuffer buffer = {NULL, 0, 0};
+    buffer_append(&buffer, word, special - word);
+    const char *p = special;
+    while (*p) {
+        if (*p != '$' && *p != '`') {
+            size_t length = strcspn(p, "$`");
+            buffer_append(&buffer, p, length);
+            p += length;
+            continue;
+        }
+        size_t used = 0;
+        if (p[0] == '`' || p[1] == '(') {
+            used = expand_substitution(&buffer, p);
+        } else if (p[1] == '?') {
+            append_variable(&buffer, "?", 1);
+            used = 2;
+        } else if (p[1] == '{') {
+            used = expand_braced(&buffer, p);
+        } else if ((used = name_length(p + 1)) > 0) {
+            append_variable(&buffer, p + 1, used);
+            used++;
+        }
+        if (used == 0) {
+            // a lone '$' or an unclosed substitution stays as it is
+            buffer_append(&buffer, p, 1);
+            used = 1;
+        }
+        p += used;
+    }
+    return buffer.data;
+}
+
+static int compare_variables(const void *a, const void *b) {
+    return strcmp((*(ShellVariable *const *)a)->name, (*(ShellVariable *const *)b)->name);
+}
+
+// export [NAME[=value]]..., without arguments lists the exported variables
+void handle_export(char **args, int arg_count) {
+    load_environment();
+    if (arg_count == 1) {
+        ShellVariable **sorted = malloc(variable_capacity * sizeof(ShellVariable *));
+        size_t count = 0;
+        for (size_t i = 0; i < variable_capacity; i++) {
+            if (variables[i].name && variables[i].value && variables[i].exported)
+                sorted[count++] = &variables[i];
+        }
+        qsort(sorted, count, sizeof(ShellVariable *), compare_variables);
+        for (size_t i = 0; i < count; i++)
+            printf("export %s=%s\n", sorted[i]->name, sorted[i]->value);
+        free(sorted);
+        return;
+    }
+
+    for (int i = 1; i < arg_count; i++) {
+        if (assign_variable(args[i], true))
+            continue;
+        if (name_length(args[i]) != strlen(args[i])) {
+            fprintf(stderr, "export: '%s': not a valid identifier\n", args[i]);
+            record_builtin_status(EXIT_FAILURE);
+            continue;
+        }
+        const char *value = get_variable(args[i]);
+        set_variable(args[i], value ? value : "", true);
+    }
+}
+
+void handle_unset(char **args, int arg_count) {
+    for (int i = 1; i < arg_count; i++)
+        unset_variable(args[i]);
+}
@@ -0,0 +1,41 @@
+#ifndef VARIABLES_H
+#define VARIABLES_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#define VARIABLE_TABLE_SIZE 256
+
+// a NULL value marks a removed variable, its slot is reused by the next set of the same name
+typedef struct {
+    char *name;
+    char *value;
+    bool exported;
+} ShellVariable;
+
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} ExpandBuffer;
+
+const char *get_variable(const char *name);
+void set_variable(const char *name, const char *value, bool exported);
+void unset_variable(const char *name);
+bool is_assignment(const char *word);
+bool assign_variable(const char *assignment, bool exported);
+char **variable_envp();
+char *expand_variables(const char *word);
+void handle_export(char **args, int arg_count);
+void handle_unset(char **args, int arg_count);
+
+#endif